@@ -84,6 +84,9 @@ consoleread(int user_dst, uint64 dst, int n)
   char cbuf;
 
   target = n;
+  // either_copyout() below runs with cons.lock held.
+  if(user_dst)
+    prefault(myproc()->pagetable, dst, n);
   acquire(&cons.lock);
   while(n > 0){
     // wait until interrupt handler has put some
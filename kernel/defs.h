@@ -7,12 +7,15 @@ struct buf;
 struct context;
 struct file;
 struct inode;
+struct iovec;
 struct pipe;
 struct proc;
 struct spinlock;
 struct sleeplock;
+struct rwsleeplock;
 struct stat;
 struct super_block;
+struct vma;
 
 // console.c
 void            consoleinit(void);
@@ -26,12 +29,19 @@ int             exec(char*, char**);
 void*           kalloc(void);
 void            kfree(void *);
 void            kinit(void);
+void*           kzalloc(void);
+int             kzero(void);
+void            kdup(void *);
+int             krefcnt(void *);
 
 // pipe.c
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
 int             piperead(struct pipe*, uint64, int);
+int             pipereadv(struct pipe*, struct iovec*, int);
 int             pipewrite(struct pipe*, uint64, int);
+int             filetopipe(struct file*, struct pipe*, int);
+int             pipetofile(struct pipe*, struct file*, int);
 
 // printf.c
 void            printf(char*, ...);
@@ -60,6 +70,9 @@ void            userinit(void);
 int             wait(uint64);
 void            wakeup(void*);
 void            yield(void);
+void            preempt(void);
+int             nice(int);
+void            runqage(void);
 int             either_copyout(int user_dst, uint64 dst, void *src, uint64 len);
 int             either_copyin(void *dst, int user_src, uint64 src, uint64 len);
 void            procdump(void);
@@ -71,6 +84,7 @@ void            swtch(struct context*, struct context*);
 void            acquire(struct spinlock*);
 int             holding(struct spinlock*);
 void            initlock(struct spinlock*, char*);
+int             lockstat(uint64, int);
 void            release(struct spinlock*);
 void            push_off(void);
 void            pop_off(void);
@@ -80,6 +94,10 @@ void            acquiresleep(struct sleeplock*);
 void            releasesleep(struct sleeplock*);
 int             holdingsleep(struct sleeplock*);
 void            initsleeplock(struct sleeplock*, char*);
+void            initrwsleeplock(struct rwsleeplock*, char*);
+void            acquirerw(struct rwsleeplock*, int);
+void            releaserw(struct rwsleeplock*);
+int             holdingrw(struct rwsleeplock*);
 
 // string.c
 int             memcmp(const void*, const void*, uint);
@@ -97,6 +115,21 @@ void            argaddr(int, uint64 *);
 int             fetchstr(uint64, char*, int);
 int             fetchaddr(uint64, uint64*);
 void            syscall();
+uint64          syscallargs(int, uint64*);
+
+// vma.c
+struct vma*     vmafind(struct proc*, uint64);
+int             vmafill(struct proc*, struct vma*, uint64);
+int             vmadup(struct proc*, struct proc*);
+void            vmaref(struct vma*);
+void            vmaunref(struct vma*);
+void            vmaclose(struct proc*);
+uint64          vmatop(struct proc*);
+uint64          mmap(struct inode*, uint64, int, int, uint);
+int             munmap(uint64, uint64);
+
+// uring.c
+void            uringfree(struct proc*);
 
 // trap.c
 extern uint     ticks;
@@ -104,6 +137,12 @@ void            trapinit(void);
 void            trapinithart(void);
 extern struct spinlock tickslock;
 void            usertrapret(void);
+void            ipi(int);
+
+// timer.c
+void            wheelinit(void);
+void            timertick(void);
+int             timersleep(int);
 
 // uart.c
 void            uartinit(void);
@@ -117,11 +156,16 @@ void            kvminit(void);
 void            kvminithart(void);
 void            kvmmap(pagetable_t, uint64, uint64, uint64, int);
 int             mappages(pagetable_t, uint64, uint64, uint64, int);
+int             mapsuperpages(pagetable_t, uint64, uint64, uint64, int);
 pagetable_t     uvmcreate(void);
 void            uvmfirst(pagetable_t, uchar *, uint);
 uint64          uvmalloc(pagetable_t, uint64, uint64, int);
 uint64          uvmdealloc(pagetable_t, uint64, uint64);
 int             uvmcopy(pagetable_t, pagetable_t, uint64);
+int             uvmshare(pagetable_t, pagetable_t, uint64, uint64, int);
+int             uvmcow(pagetable_t, uint64);
+int             vmfault(pagetable_t, uint64, int);
+void            prefault(pagetable_t, uint64, uint64);
 void            uvmfree(pagetable_t, uint64);
 void            uvmunmap(pagetable_t, uint64, uint64, int);
 void            uvmclear(pagetable_t, uint64);
@@ -140,6 +184,7 @@ void            plic_complete(int);
 // virtio_disk.c
 void            virtio_disk_init(void);
 void            virtio_disk_rw(struct buf *, int);
+void            virtio_disk_rwblocks(uint, void *, int, int);
 void            virtio_disk_intr(void);
 
 // number of elements in fixed-size array
@@ -6,10 +6,9 @@
 #include "proc.h"
 #include "defs.h"
 #include "elf.h"
+#include "mman.h"
 #include "vfs.h"
 #include "vfs_defs.h"
-static int loadseg(pde_t *, uint64, struct inode *, uint, uint);
-
 int flags2perm(int flags)
 {
     int perm = 0;
@@ -31,11 +30,14 @@ exec(char *path, char **argv)
   struct proghdr ph;
   pagetable_t pagetable = 0, oldpagetable;
   struct proc *p = myproc();
+  struct vma vma[NVMA], *v;
+
+  memset(vma, 0, sizeof(vma));
 
   if((ip = namei(path)) == 0){
     return -1;
   }
-  ilock(ip);
+  ilockshared(ip);
 
   // Check ELF header
   if(ip->op->read(ip, 0, (uint64)&elf, 0, sizeof(elf)) != sizeof(elf))
@@ -47,7 +49,9 @@ exec(char *path, char **argv)
   if((pagetable = proc_pagetable(p)) == 0)
     goto bad;
 
-  // Load program into memory.
+  // Record each segment as a file-backed area; vmfault()
+  // reads its pages in as the program touches them.
+  v = vma;
   for(i=0, off=elf.phoff; i<elf.phnum; i++, off+=sizeof(ph)){
     if(ip->op->read(ip, 0, (uint64)&ph, off, sizeof(ph)) != sizeof(ph))
       goto bad;
@@ -59,12 +63,21 @@ exec(char *path, char **argv)
       goto bad;
     if(ph.vaddr % PGSIZE != 0)
       goto bad;
-    uint64 sz1;
-    if((sz1 = uvmalloc(pagetable, sz, ph.vaddr + ph.memsz, flags2perm(ph.flags))) == 0)
+    if(ph.vaddr + ph.memsz >= URING || ph.off + ph.filesz > ip->size)
       goto bad;
-    sz = sz1;
-    if(loadseg(pagetable, ph.vaddr, ip, ph.off, ph.filesz) < 0)
+    if(v == &vma[NVMA])
       goto bad;
+    v->ip = ip;
+    v->start = ph.vaddr;
+    v->end = ph.vaddr + ph.memsz;
+    v->perm = flags2perm(ph.flags);
+    v->flags = MAP_PRIVATE;
+    v->off = ph.off;
+    v->filesz = ph.filesz;
+    vmaref(v);
+    v++;
+    if(ph.vaddr + ph.memsz > sz)
+      sz = ph.vaddr + ph.memsz;
   }
   iunlockput(ip);
   ip = 0;
@@ -117,9 +130,15 @@ exec(char *path, char **argv)
       last = s+1;
   safestrcpy(p->name, last, sizeof(p->name));
     
-  // Commit to the user image.
+  // Commit to the user image. The rings and areas, if any,
+  // belong to the old one.
+  uringfree(p);
+  vmaclose(p);
+  memmove(p->vma, vma, sizeof(vma));
   oldpagetable = p->pagetable;
   p->pagetable = pagetable;
+  // the ASID stays, so drop the old table's TLB entries.
+  sfence_vma_asid(p->asid);
   p->sz = sz;
   p->trapframe->epc = elf.entry;  // initial program counter = main
   p->trapframe->sp = sp; // initial stack pointer
@@ -133,30 +152,8 @@ exec(char *path, char **argv)
   if(ip){
     iunlockput(ip);
   }
+  for(v = vma; v < &vma[NVMA]; v++)
+    if(v->ip)
+      vmaunref(v);
   return -1;
 }
-
-// Load a program segment into pagetable at virtual address va.
-// va must be page-aligned
-// and the pages from va to va+sz must already be mapped.
-// Returns 0 on success, -1 on failure.
-static int
-loadseg(pagetable_t pagetable, uint64 va, struct inode *ip, uint offset, uint sz)
-{
-  uint i, n;
-  uint64 pa;
-
-  for(i = 0; i < sz; i += PGSIZE){
-    pa = walkaddr(pagetable, va + i);
-    if(pa == 0)
-      panic("loadseg: address should exist");
-    if(sz - i < PGSIZE)
-      n = sz - i;
-    else
-      n = PGSIZE;
-    if(ip->op->read(ip, 0, (uint64)pa, offset+i, n) != n)
-      return -1;
-  }
-  
-  return 0;
-}
@@ -0,0 +1,130 @@
+//
+// Page cache: whole pages of file data kept in memory per
+// inode, so that processes executing the same program or
+// mapping the same file can map the same physical pages.
+// All reads and writes of regular files go through these
+// pages; the buffer cache holds only metadata.
+//
+// ip->pages is the root of a two-level radix tree indexed by
+// file offset / PGSIZE. Each node is a page of PCFAN
+// pointers: the root points to leaf nodes, and leaves point
+// to cached pages. The cache holds one reference to each
+// page (see kdup() in kalloc.c); a process that maps one
+// holds another, so a page dropped from the cache lives on
+// until the last mapping goes away.
+//
+// The cache lives only as long as the in-memory inode is
+// referenced: iput() drops it with the last reference. So
+// pages are shared only while some process holds the file
+// (by running it, mapping it or having it open), and a
+// short-lived program such as cat in a pipeline is read from
+// disk again each time it runs. Keeping unreferenced pages
+// would need a way to take them back when memory runs short.
+//
+// Running programs map the cached pages of their text, so
+// writing or truncating such a file is refused while it is
+// mapped (see ntext in struct inode). Truncation drops the
+// cache: a MAP_SHARED mapping keeps the pages it had, no
+// longer part of the file, so it does not see later write()s,
+// and munmap() writes its dirty pages back only if they are
+// still inside the file.
+//
+// Callers must hold ip->lock, at least shared. Readers
+// sharing it may fill pages concurrently, so pcget() adds
+// to the tree under ip->pagelock. pcfree() needs ip->lock
+// held exclusively, or the inode to have no other references.
+//
+
+#include "types.h"
+#include "riscv.h"
+#include "defs.h"
+#include "param.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "sleeplock.h"
+#include "vfs_defs.h"
+
+#define PCFAN (PGSIZE / sizeof(void*))  // pointers per node
+#define PCMAX (PCFAN * PCFAN)           // pages per file
+
+// Return the slot for page pgno of ip, allocating the
+// nodes on the way if alloc is set. Returns 0 if pgno is
+// not cached and alloc is not set, or if out of memory.
+static char**
+pcslot(struct inode *ip, uint pgno, int alloc)
+{
+  char ***root = (char***)ip->pages;
+  char **leaf;
+
+  if(pgno >= PCMAX)
+    return 0;
+  if(root == 0){
+    if(!alloc || (root = kzalloc()) == 0)
+      return 0;
+    ip->pages = (void**)root;
+  }
+  if((leaf = root[pgno / PCFAN]) == 0){
+    if(!alloc || (leaf = kzalloc()) == 0)
+      return 0;
+    root[pgno / PCFAN] = leaf;
+  }
+  return &leaf[pgno % PCFAN];
+}
+
+// Return the cached page pgno of ip, reading it in if it is
+// not cached. Bytes past the end of the file read as zero.
+// The cache keeps its reference; a caller that wants to
+// hold on to the page must kdup() it.
+// Returns 0 if out of memory or the read fails.
+char*
+pcget(struct inode *ip, uint pgno)
+{
+  char **slot, *pa;
+
+  acquire(&ip->pagelock);
+  slot = pcslot(ip, pgno, 1);
+  pa = slot ? *slot : 0;
+  release(&ip->pagelock);
+  if(slot == 0)
+    return 0;
+  if(pa)
+    return pa;
+
+  if((pa = kzalloc()) == 0)
+    return 0;
+  if((uint64)pgno * PGSIZE < ip->size && ip->op->readpage(ip, pgno, pa) < 0){
+    kfree(pa);
+    return 0;
+  }
+  // another reader may have read the page in meanwhile.
+  acquire(&ip->pagelock);
+  if(*slot){
+    kfree(pa);
+    pa = *slot;
+  } else {
+    *slot = pa;
+  }
+  release(&ip->pagelock);
+  return pa;
+}
+
+// Drop every cached page of ip, and the tree itself.
+void
+pcfree(struct inode *ip)
+{
+  char ***root = (char***)ip->pages;
+  int i, j;
+
+  if(root == 0)
+    return;
+  for(i = 0; i < PCFAN; i++){
+    if(root[i] == 0)
+      continue;
+    for(j = 0; j < PCFAN; j++)
+      if(root[i][j])
+        kfree(root[i][j]);
+    kfree(root[i]);
+  }
+  kfree(root);
+  ip->pages = 0;
+}
@@ -6,51 +6,78 @@
 #include "proc.h"
 #include "sleeplock.h"
 #include "vfs_defs.h"
-#define PIPESIZE 512
+#include "uio.h"
+
+// The ring is a whole page of its own, so a writer can
+// queue a full page before it has to wait for the reader.
+#define PIPESIZE PGSIZE
 
 struct pipe {
   struct spinlock lock;
-  char data[PIPESIZE];
+  char *data;     // PIPESIZE-byte ring
   uint nread;     // number of bytes read
   uint nwrite;    // number of bytes written
   int readopen;   // read fd is still open
   int writeopen;  // write fd is still open
+  // splice() fills or drains a span of data[] with the lock
+  // released; while it does, other writers (wbusy) or readers
+  // (rbusy) must wait, and set wwant/rwant to be woken.
+  char wbusy;
+  char rbusy;
+  char wwant;
+  char rwant;
+};
+
+static void pipefileclose(struct file *f);
+
+// Pipe files have no inode; only close goes through op,
+// read and write are dispatched on FD_PIPE in vfs.c.
+struct filesystem_operations pipe_op = {
+  .close = pipefileclose,
 };
 
 int
 pipealloc(struct file **f0, struct file **f1)
 {
-  // struct pipe *pi;
-
-  // pi = 0;
-  // *f0 = *f1 = 0;
-  // if((*f0 = filealloc()) == 0 || (*f1 = filealloc()) == 0)
-  //   goto bad;
-  // if((pi = (struct pipe*)kalloc()) == 0)
-  //   goto bad;
-  // pi->readopen = 1;
-  // pi->writeopen = 1;
-  // pi->nwrite = 0;
-  // pi->nread = 0;
-  // initlock(&pi->lock, "pipe");
-  // (*f0)->type = FD_PIPE;
-  // (*f0)->readable = 1;
-  // (*f0)->writable = 0;
-  // (*f0)->pipe = pi;
-  // (*f1)->type = FD_PIPE;
-  // (*f1)->readable = 0;
-  // (*f1)->writable = 1;
-  // (*f1)->pipe = pi;
+  struct pipe *pi;
+
+  pi = 0;
+  *f0 = *f1 = 0;
+  if((*f0 = filealloc()) == 0 || (*f1 = filealloc()) == 0)
+    goto bad;
+  if((pi = (struct pipe*)kalloc()) == 0)
+    goto bad;
+  if((pi->data = kalloc()) == 0)
+    goto bad;
+  pi->readopen = 1;
+  pi->writeopen = 1;
+  pi->nwrite = 0;
+  pi->nread = 0;
+  pi->wbusy = pi->rbusy = 0;
+  pi->wwant = pi->rwant = 0;
+  initlock(&pi->lock, "pipe");
+  (*f0)->type = FD_PIPE;
+  (*f0)->op = &pipe_op;
+  (*f0)->readable = 1;
+  (*f0)->writable = 0;
+  (*f0)->inode = 0;
+  (*f0)->private = pi;
+  (*f1)->type = FD_PIPE;
+  (*f1)->op = &pipe_op;
+  (*f1)->readable = 0;
+  (*f1)->writable = 1;
+  (*f1)->inode = 0;
+  (*f1)->private = pi;
   return 0;
 
-//  bad:
-//   if(pi)
-//     kfree((char*)pi);
-//   if(*f0)
-//     (*f0)->op->close(*f0);
-//   if(*f1)
-//     (*f0)->op->close(*f1);
-//   return -1;
+ bad:
+  if(pi)
+    kfree((char*)pi);
+  if(*f0)
+    (*f0)->ref = 0;
+  if(*f1)
+    (*f1)->ref = 0;
+  return -1;
 }
 
 void
@@ -66,63 +93,266 @@ pipeclose(struct pipe *pi, int writable)
   }
   if(pi->readopen == 0 && pi->writeopen == 0){
     release(&pi->lock);
+    kfree(pi->data);
     kfree((char*)pi);
   } else
     release(&pi->lock);
 }
 
+static void
+pipefileclose(struct file *f)
+{
+  if(f->ref < 1)
+    panic("pipefileclose");
+  if(--f->ref > 0)
+    return;
+  f->ref = 0;
+  f->type = FD_NONE;
+  pipeclose((struct pipe*)f->private, f->writable);
+  f->private = 0;
+}
+
 int
 pipewrite(struct pipe *pi, uint64 addr, int n)
 {
-  int i = 0;
+  int i = 0, m, wake = 0;
+  uint off;
   struct proc *pr = myproc();
 
+  // copyin() below runs with pi->lock held.
+  prefault(pr->pagetable, addr, n);
   acquire(&pi->lock);
   while(i < n){
     if(pi->readopen == 0 || killed(pr)){
+      if(wake)
+        wakeup(&pi->nread);
       release(&pi->lock);
       return -1;
     }
-    if(pi->nwrite == pi->nread + PIPESIZE){ //DOC: pipewrite-full
+    if(pi->wbusy){
+      pi->wwant = 1;
+      sleep(&pi->nwrite, &pi->lock);
+    } else if(pi->nwrite == pi->nread + PIPESIZE){ //DOC: pipewrite-full
+      // Wake the reader once per full ring, not once per chunk.
       wakeup(&pi->nread);
+      wake = 0;
       sleep(&pi->nwrite, &pi->lock);
     } else {
-      char ch;
-      if(copyin(pr->pagetable, &ch, addr + i, 1) == -1)
+      // Copy as much as fits before the free space or the
+      // end of the ring wraps.
+      off = pi->nwrite % PIPESIZE;
+      m = min(n - i, PIPESIZE - (pi->nwrite - pi->nread));
+      m = min(m, PIPESIZE - off);
+      if(copyin(pr->pagetable, pi->data + off, addr + i, m) == -1)
         break;
-      pi->data[pi->nwrite++ % PIPESIZE] = ch;
-      i++;
+      // A reader can only be asleep if the ring was empty.
+      if(pi->nwrite == pi->nread)
+        wake = 1;
+      pi->nwrite += m;
+      i += m;
     }
   }
-  wakeup(&pi->nread);
+  if(wake)
+    wakeup(&pi->nread);
   release(&pi->lock);
 
   return i;
 }
 
-int
-piperead(struct pipe *pi, uint64 addr, int n)
+// Wait until pi has data or no writer, and no splice
+// is draining it. Caller must hold pi->lock.
+static int
+pipewait(struct pipe *pi)
 {
-  int i;
   struct proc *pr = myproc();
-  char ch;
 
-  acquire(&pi->lock);
-  while(pi->nread == pi->nwrite && pi->writeopen){  //DOC: pipe-empty
-    if(killed(pr)){
-      release(&pi->lock);
+  while(pi->rbusy || (pi->nread == pi->nwrite && pi->writeopen)){  //DOC: pipe-empty
+    if(killed(pr))
       return -1;
-    }
+    if(pi->rbusy)
+      pi->rwant = 1;
     sleep(&pi->nread, &pi->lock); //DOC: piperead-sleep
   }
-  for(i = 0; i < n; i++){  //DOC: piperead-copy
-    if(pi->nread == pi->nwrite)
-      break;
-    ch = pi->data[pi->nread++ % PIPESIZE];
-    if(copyout(pr->pagetable, addr + i, &ch, 1) == -1)
+  return 0;
+}
+
+// Copy up to n buffered bytes out to addr without blocking.
+// Caller must hold pi->lock.
+static int
+pipecopyout(struct pipe *pi, uint64 addr, int n)
+{
+  int i = 0, m;
+  uint off;
+  struct proc *pr = myproc();
+
+  while(i < n && pi->nread != pi->nwrite){  //DOC: piperead-copy
+    off = pi->nread % PIPESIZE;
+    m = min(n - i, pi->nwrite - pi->nread);
+    m = min(m, PIPESIZE - off);
+    if(copyout(pr->pagetable, addr + i, pi->data + off, m) == -1)
       break;
+    pi->nread += m;
+    i += m;
+  }
+  return i;
+}
+
+int
+piperead(struct pipe *pi, uint64 addr, int n)
+{
+  int i, full;
+
+  prefault(myproc()->pagetable, addr, n);
+  acquire(&pi->lock);
+  if(pipewait(pi) < 0){
+    release(&pi->lock);
+    return -1;
   }
-  wakeup(&pi->nwrite);  //DOC: piperead-wakeup
+  // A writer can only be asleep if the ring was full.
+  full = pi->nwrite == pi->nread + PIPESIZE;
+  i = pipecopyout(pi, addr, n);
+  if(full && i > 0)
+    wakeup(&pi->nwrite);  //DOC: piperead-wakeup
   release(&pi->lock);
   return i;
 }
+
+// Like piperead, but scatters into the iovcnt buffers of iov.
+// Blocks only until some data is available.
+int
+pipereadv(struct pipe *pi, struct iovec *iov, int iovcnt)
+{
+  int i, r, tot = 0, full;
+
+  for(i = 0; i < iovcnt; i++)
+    prefault(myproc()->pagetable, (uint64)iov[i].iov_base, iov[i].iov_len);
+  acquire(&pi->lock);
+  if(pipewait(pi) < 0){
+    release(&pi->lock);
+    return -1;
+  }
+  full = pi->nwrite == pi->nread + PIPESIZE;
+  for(i = 0; i < iovcnt; i++){
+    r = pipecopyout(pi, (uint64)iov[i].iov_base, iov[i].iov_len);
+    tot += r;
+    if(r != iov[i].iov_len)
+      break;
+  }
+  if(full && tot > 0)
+    wakeup(&pi->nwrite);
+  release(&pi->lock);
+  return tot;
+}
+
+// Move up to n bytes from file f, at f->off, into pi.
+// The file system reads straight into the ring, so the data
+// is copied once, from the page cache. Blocks while the
+// ring is full, like pipewrite. Returns bytes moved, 0 at
+// end of file.
+int
+filetopipe(struct file *f, struct pipe *pi, int n)
+{
+  int tot = 0, r, m, empty;
+  uint off;
+  struct proc *pr = myproc();
+
+  while(tot < n){
+    acquire(&pi->lock);
+    while(pi->wbusy || pi->nwrite == pi->nread + PIPESIZE){
+      if(pi->readopen == 0 || killed(pr))
+        break;
+      if(pi->wbusy)
+        pi->wwant = 1;
+      sleep(&pi->nwrite, &pi->lock);
+    }
+    if(pi->readopen == 0 || killed(pr)){
+      release(&pi->lock);
+      return tot > 0 ? tot : -1;
+    }
+    off = pi->nwrite % PIPESIZE;
+    m = min(n - tot, PIPESIZE - (pi->nwrite - pi->nread));
+    m = min(m, PIPESIZE - off);
+    pi->wbusy = 1;
+    release(&pi->lock);
+
+    ilock(f->inode);
+    if((r = f->inode->op->read(f->inode, 0, (uint64)(pi->data + off), f->off, m)) > 0)
+      f->off += r;
+    iunlock(f->inode);
+
+    acquire(&pi->lock);
+    empty = pi->nwrite == pi->nread;
+    if(r > 0)
+      pi->nwrite += r;
+    pi->wbusy = 0;
+    if(pi->wwant){
+      pi->wwant = 0;
+      wakeup(&pi->nwrite);
+    }
+    if(empty && r > 0)
+      wakeup(&pi->nread);
+    release(&pi->lock);
+
+    if(r < 0)
+      return tot > 0 ? tot : -1;
+    tot += r;
+    if(r < m)
+      break;  // end of file
+  }
+  return tot;
+}
+
+// Move up to n bytes from pi into file f at f->off, writing
+// straight from the ring. Blocks only until some data is
+// available, like piperead. Returns bytes moved, 0 once the
+// pipe is empty and has no writer.
+int
+pipetofile(struct pipe *pi, struct file *f, int n)
+{
+  int tot = 0, r, m, full;
+  uint off;
+
+  while(tot < n){
+    acquire(&pi->lock);
+    if(tot > 0 && (pi->rbusy || pi->nread == pi->nwrite)){
+      release(&pi->lock);
+      break;
+    }
+    if(pipewait(pi) < 0){
+      release(&pi->lock);
+      return tot > 0 ? tot : -1;
+    }
+    if(pi->nread == pi->nwrite){
+      release(&pi->lock);
+      break;  // no data and no writer
+    }
+    off = pi->nread % PIPESIZE;
+    m = min(n - tot, pi->nwrite - pi->nread);
+    m = min(m, PIPESIZE - off);
+    pi->rbusy = 1;
+    release(&pi->lock);
+
+    ilock(f->inode);
+    if((r = f->inode->op->write(f->inode, 0, (uint64)(pi->data + off), f->off, m)) > 0)
+      f->off += r;
+    iunlock(f->inode);
+
+    acquire(&pi->lock);
+    full = pi->nwrite == pi->nread + PIPESIZE;
+    if(r > 0)
+      pi->nread += r;
+    pi->rbusy = 0;
+    if(pi->rwant){
+      pi->rwant = 0;
+      wakeup(&pi->nread);
+    }
+    if(full && r > 0)
+      wakeup(&pi->nwrite);
+    release(&pi->lock);
+
+    if(r != m)
+      return tot > 0 ? tot : -1;
+    tot += r;
+  }
+  return tot;
+}
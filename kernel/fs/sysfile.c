@@ -14,6 +14,8 @@
 #include "proc.h"
 #include "sleeplock.h"
 #include "xv6_fcntl.h"
+#include "uio.h"
+#include "mman.h"
 #include "vfs.h"
 #include "vfs_defs.h"
 #include <time.h>
@@ -95,6 +97,196 @@ sys_write(void)
   return filewrite(f, p, n);
 }
 
+// Fetch the user iovec array at argument n into iov,
+// checking iovcnt and that the total length fits in the
+// int that readv() and writev() return.
+static int
+argiov(int n, struct iovec *iov, int iovcnt)
+{
+  uint64 uiov, tot = 0;
+  int i;
+
+  argaddr(n, &uiov);
+  if(iovcnt < 0 || iovcnt > IOV_MAX)
+    return -1;
+  if(copyin(myproc()->pagetable, (char*)iov, uiov, iovcnt*sizeof(*iov)) < 0)
+    return -1;
+  for(i = 0; i < iovcnt; i++){
+    tot += iov[i].iov_len;
+    if(tot > 0x7fffffff)
+      return -1;
+  }
+  return 0;
+}
+
+uint64
+sys_readv(void)
+{
+  struct file *f;
+  struct iovec iov[IOV_MAX];
+  int iovcnt;
+
+  argint(2, &iovcnt);
+  if(argfd(0, 0, &f) < 0 || argiov(1, iov, iovcnt) < 0)
+    return -1;
+  return filereadv(f, iov, iovcnt);
+}
+
+uint64
+sys_writev(void)
+{
+  struct file *f;
+  struct iovec iov[IOV_MAX];
+  int iovcnt;
+
+  argint(2, &iovcnt);
+  if(argfd(0, 0, &f) < 0 || argiov(1, iov, iovcnt) < 0)
+    return -1;
+  return filewritev(f, iov, iovcnt);
+}
+
+uint64
+sys_pread(void)
+{
+  struct file *f;
+  int n, off;
+  uint64 p;
+
+  argaddr(1, &p);
+  argint(2, &n);
+  argint(3, &off);
+  if(argfd(0, 0, &f) < 0)
+    return -1;
+  return filepread(f, p, n, off);
+}
+
+uint64
+sys_pwrite(void)
+{
+  struct file *f;
+  int n, off;
+  uint64 p;
+
+  argaddr(1, &p);
+  argint(2, &n);
+  argint(3, &off);
+  if(argfd(0, 0, &f) < 0)
+    return -1;
+  return filepwrite(f, p, n, off);
+}
+
+uint64
+sys_lseek(void)
+{
+  struct file *f;
+  int off, whence;
+
+  argint(1, &off);
+  argint(2, &whence);
+  if(argfd(0, 0, &f) < 0)
+    return -1;
+  return filelseek(f, off, whence);
+}
+
+// Move bytes between a file and a pipe without
+// copying them through user space.
+uint64
+sys_splice(void)
+{
+  struct file *fin, *fout;
+  int n;
+
+  argint(2, &n);
+  if(argfd(0, 0, &fin) < 0 || argfd(1, 0, &fout) < 0)
+    return -1;
+  return filesplice(fin, fout, n);
+}
+
+// Copy n bytes from fin to fout at their offsets, through
+// a kernel page rather than user space. Returns bytes
+// copied, or -1 if nothing could be.
+static int
+copybounce(struct file *fin, struct file *fout, int n)
+{
+  char *buf;
+  int tot = 0, m, r, w;
+
+  if((buf = kalloc()) == 0)
+    return -1;
+  while(tot < n){
+    m = min(n - tot, PGSIZE);
+    ilock(fin->inode);
+    if((r = fin->inode->op->read(fin->inode, 0, (uint64)buf, fin->off, m)) > 0)
+      fin->off += r;
+    iunlock(fin->inode);
+    if(r < 0 && tot == 0)
+      tot = -1;
+    if(r <= 0)
+      break;
+    ilock(fout->inode);
+    if((w = fout->inode->op->write(fout->inode, 0, (uint64)buf, fout->off, r)) > 0)
+      fout->off += w;
+    iunlock(fout->inode);
+    if(w != r){
+      // leave fin->off just past what reached fout.
+      if(w < 0)
+        w = 0;
+      fin->off -= r - w;
+      tot += w;
+      if(tot == 0)
+        tot = -1;
+      break;
+    }
+    tot += r;
+    if(r < m)
+      break;
+  }
+  kfree(buf);
+  return tot;
+}
+
+// Copy n bytes from file in to file out at their offsets
+// in one system call. Copies within one file system go
+// block to block in the buffer cache.
+uint64
+sys_copy_file_range(void)
+{
+  struct file *fin, *fout;
+  struct inode *src, *dst;
+  int n, r;
+
+  argint(2, &n);
+  if(argfd(0, 0, &fin) < 0 || argfd(1, 0, &fout) < 0)
+    return -1;
+  if(fin->readable == 0 || fout->writable == 0 || n < 0)
+    return -1;
+  if(fin->type != FD_INODE || fout->type != FD_INODE)
+    return -1;
+  src = fin->inode;
+  dst = fout->inode;
+  if(src == dst || src->op != dst->op || src->op->copy_range == 0)
+    return copybounce(fin, fout, n);
+
+  // Two file locks: take the lower inode number first
+  // (see struct inode).
+  if(src->inum < dst->inum){
+    ilock(src);
+    ilock(dst);
+  } else {
+    ilock(dst);
+    ilock(src);
+  }
+  if(src->type != T_FILE || dst->type != T_FILE){
+    r = -1;
+  } else if((r = src->op->copy_range(src, fin->off, dst, fout->off, n)) > 0){
+    fin->off += r;
+    fout->off += r;
+  }
+  iunlock(src);
+  iunlock(dst);
+  return r;
+}
+
 uint64
 sys_close(void)
 {
@@ -186,6 +378,30 @@ sys_unlink(void)
   return ret;
 }
 
+// Move the link old to new, replacing new if it exists.
+uint64
+sys_rename(void)
+{
+  char old[MAXPATH], new[MAXPATH];
+  struct dentry src, dst;
+  int ret;
+
+  if(argstr(0, old, MAXPATH) < 0 || argstr(1, new, MAXPATH) < 0)
+    return -1;
+  memset(&src, 0, sizeof(src));
+  memset(&dst, 0, sizeof(dst));
+  if((src.parent = nameiparent(old, src.name)) == 0)
+    return -1;
+  if((dst.parent = nameiparent(new, dst.name)) == 0){
+    iput(src.parent);
+    return -1;
+  }
+  ret = src.parent->op->rename(&src, &dst);
+  iput(dst.parent);
+  iput(src.parent);
+  return ret;
+}
+
 static struct inode*
 create(char *path, short type, short major, short minor)
 {
@@ -235,6 +451,11 @@ sys_open(void)
       return -1;
     }
   }
+  // a running program's text cannot be truncated.
+  if((omode & O_TRUNC) && ip->ntext > 0){
+    iunlockput(ip);
+    return -1;
+  }
   f = ip->op->open(ip, omode);
   if(f == 0 || (fd = fdalloc(f)) < 0){
     if(f)
@@ -349,29 +570,69 @@ sys_exec(void)
 uint64
 sys_pipe(void)
 {
-  // uint64 fdarray; // user pointer to array of two integers
-  // struct xv6fs_file *rf, *wf;
-  // int fd0, fd1;
-  // struct proc *p = myproc();
-
-  // argaddr(0, &fdarray);
-  // if(pipealloc(&rf, &wf) < 0)
-  //   return -1;
-  // fd0 = -1;
-  // if((fd0 = fdalloc(rf)) < 0 || (fd1 = fdalloc(wf)) < 0){
-  //   if(fd0 >= 0)
-  //     p->ofile[fd0] = 0;
-  //   xv6fs_fileclose(rf);
-  //   xv6fs_fileclose(wf);
-  //   return -1;
-  // }
-  // if(copyout(p->pagetable, fdarray, (char*)&fd0, sizeof(fd0)) < 0 ||
-  //    copyout(p->pagetable, fdarray+sizeof(fd0), (char *)&fd1, sizeof(fd1)) < 0){
-  //   p->ofile[fd0] = 0;
-  //   p->ofile[fd1] = 0;
-  //   xv6fs_fileclose(rf);
-  //   xv6fs_fileclose(wf);
-  //   return -1;
-  // }
+  uint64 fdarray; // user pointer to array of two integers
+  struct file *rf, *wf;
+  int fd0, fd1;
+  struct proc *p = myproc();
+
+  argaddr(0, &fdarray);
+  if(pipealloc(&rf, &wf) < 0)
+    return -1;
+  fd0 = -1;
+  if((fd0 = fdalloc(rf)) < 0 || (fd1 = fdalloc(wf)) < 0){
+    if(fd0 >= 0)
+      p->ofile[fd0] = 0;
+    rf->op->close(rf);
+    wf->op->close(wf);
+    return -1;
+  }
+  if(copyout(p->pagetable, fdarray, (char*)&fd0, sizeof(fd0)) < 0 ||
+     copyout(p->pagetable, fdarray+sizeof(fd0), (char *)&fd1, sizeof(fd1)) < 0){
+    p->ofile[fd0] = 0;
+    p->ofile[fd1] = 0;
+    rf->op->close(rf);
+    wf->op->close(wf);
+    return -1;
+  }
   return 0;
 }
+
+// Map a regular file into memory. addr is ignored; the
+// kernel picks the address. off must be page-aligned.
+uint64
+sys_mmap(void)
+{
+  uint64 addr, len;
+  int prot, flags, off, perm;
+  struct file *f;
+
+  argaddr(0, &addr);
+  argaddr(1, &len);
+  argint(2, &prot);
+  argint(3, &flags);
+  argint(5, &off);
+  if(argfd(4, 0, &f) < 0)
+    return -1;
+  if(f->type != FD_INODE || f->inode->type != T_FILE)
+    return -1;
+  if(off < 0 || off % PGSIZE != 0 || (flags != MAP_SHARED && flags != MAP_PRIVATE))
+    return -1;
+  if(!f->readable || (flags == MAP_SHARED && (prot & PROT_WRITE) && !f->writable))
+    return -1;
+  perm = 0;
+  if(prot & PROT_WRITE)
+    perm |= PTE_W;
+  if(prot & PROT_EXEC)
+    perm |= PTE_X;
+  return mmap(f->inode, len, perm, flags, off);
+}
+
+uint64
+sys_munmap(void)
+{
+  uint64 addr, len;
+
+  argaddr(0, &addr);
+  argaddr(1, &len);
+  return munmap(addr, len);
+}
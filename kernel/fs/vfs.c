@@ -12,6 +12,8 @@
 #include "vfs.h"
 #include "vfs_defs.h"
 #include "xv6fs/fs.h"
+#include "xv6_fcntl.h"
+#include "uio.h"
 #include <time.h>
 
 struct super_block *root;
@@ -28,7 +30,8 @@ struct ft {
 void iinit() {
   // printf("enter iinit\n");
   for (int i = 0; i < NINODE; i++) {
-    initsleeplock(&itable.inode[i].lock, "inode");
+    initrwsleeplock(&itable.inode[i].lock, "inode");
+    initlock(&itable.inode[i].pagelock, "pages");
   }
   // printf("quit iinit\n");
 }
@@ -69,6 +72,7 @@ struct inode* iget(uint dev, uint inum) {
   ip->op = &xv6fs_op;
   ip->inum = inum;
   ip->ref = 1;
+  ip->pages = NULL;
   ip->private = NULL;
   // printf("quit iget\n");
   return ip;
@@ -85,16 +89,30 @@ void ilock(struct inode *ip) {
   // printf("enter ilock\n");
   if (ip == 0 || ip->ref < 1)
     panic("ilock");
-  acquiresleep(&ip->lock);
+  acquirerw(&ip->lock, 0);
   ip->op->read_block(ip);
   // printf("quit ilock\n");
 }
 
+// Lock ip shared, for reading its contents or attributes:
+// readers do not wait for each other, only for writers.
+// The first lock of an inode reads it in from disk, which
+// must be done exclusively.
+void ilockshared(struct inode *ip) {
+  if (ip == 0 || ip->ref < 1)
+    panic("ilockshared");
+  if (ip->private == 0) {
+    ilock(ip);
+    iunlock(ip);
+  }
+  acquirerw(&ip->lock, 1);
+}
+
 void   iunlock(struct inode *ip) {
   // printf("enter iunlock\n");
-  if (ip == 0 || !holdingsleep(&ip->lock) || ip->ref < 1)
+  if (ip == 0 || !holdingrw(&ip->lock) || ip->ref < 1)
     panic("iunlock");
-  releasesleep(&ip->lock);
+  releaserw(&ip->lock);
   // printf("quit iunlock\n");
 }
 
@@ -111,13 +129,17 @@ void stati(struct inode *ip, struct stat *st) {
 void iput(struct inode *ip) {
   // printf("enter iput\n");
   if (ip->ref == 1 && ip->private != 0 && ip->nlink == 0) {
-    acquiresleep(&ip->lock);
+    acquirerw(&ip->lock, 0);
     ip->op->trunc(ip);
     ip->type = 0;
     ip->op->write_inode(ip);
     kfree(ip->private);
-    releasesleep(&ip->lock);
+    releaserw(&ip->lock);
   }
+  // the page cache goes with the last reference; see
+  // pagecache.c.
+  if (ip->ref == 1)
+    pcfree(ip);
   ip->ref--;
   // printf("quit iput\n");
 }
@@ -266,7 +288,7 @@ int filestat(struct file *f, uint64 addr) {
   struct stat st;
 
   if (f->type == FD_INODE || f->type == FD_DEVICE) {
-    ilock(f->inode);
+    ilockshared(f->inode);
     stati(f->inode, &st);
     iunlock(f->inode);
     if (copyout(p->pagetable, addr, (char *)&st, sizeof(st)) < 0) {
@@ -280,49 +302,67 @@ int filestat(struct file *f, uint64 addr) {
   return -1;
 }
 
-int fileread(struct file *f, uint64 addr, int n) {
-  // printf("enter fileread\n");
+// Lock f's inode for reading at *poff: shared, unless *poff
+// is f->off and another descriptor shares f, since readers
+// then update f->off in turn. With only one reference, only
+// its process can be using f.
+static void ilockread(struct file *f, int *poff) {
+  if (poff == &f->off && f->ref > 1)
+    ilock(f->inode);
+  else
+    ilockshared(f->inode);
+}
+
+// Read n bytes at *poff, advancing *poff by the amount read.
+// *poff is f->off for read() and a private copy for pread(),
+// and is only touched with the inode locked.
+static int readat(struct file *f, uint64 addr, int n, int *poff) {
   int r = 0;
 
   if (f->readable == 0) {
-    // printf("quit fileread\n");
     return -1;
   }
 
-  if (f->type == FD_DEVICE) {
+  if (f->type == FD_PIPE) {
+    r = piperead(f->private, addr, n);
+  } else if (f->type == FD_DEVICE) {
     r = devsw[CONSOLE].read(1, addr, n);
   } else if (f->type == FD_INODE) {
-    ilock(f->inode);
-    if ((r = f->inode->op->read(f->inode, 1, addr, f->off, n)) > 0)
-      f->off += r;
+    // A fault on a file-backed page must not happen with
+    // the inode locked; see prefault().
+    prefault(myproc()->pagetable, addr, n);
+    ilockread(f, poff);
+    if ((r = f->inode->op->read(f->inode, 1, addr, *poff, n)) > 0)
+      *poff += r;
     iunlock(f->inode);
   }
-  // printf("quit fileread\n");
   return r;
 }
 
-int filewrite(struct file *f, uint64 addr, int n) {
-  // printf("enter filewrite\n");
+// Write n bytes at *poff, advancing *poff; see readat().
+static int writeat(struct file *f, uint64 addr, int n, int *poff) {
   int r, ret = 0;
 
   if (f->writable == 0) {
-    // printf("quit filewrite\n");
     return -1;
   }
 
-  if (f->type == FD_DEVICE) {
+  if (f->type == FD_PIPE) {
+    ret = pipewrite(f->private, addr, n);
+  } else if (f->type == FD_DEVICE) {
     ret = devsw[CONSOLE].write(1, addr, n);
   } else if (f->type == FD_INODE) {
     int max = ((MAXOPBLOCKS-1-1-2) / 2) * BSIZE;
     int i = 0;
+    prefault(myproc()->pagetable, addr, n);
     while (i < n) {
       int n1 = n - i;
       if (n1 > max)
         n1 = max;
 
       ilock(f->inode);
-      if ((r = f->inode->op->write(f->inode, 1, addr + i, f->off, n1)) > 0)
-        f->off += r;
+      if ((r = f->inode->op->write(f->inode, 1, addr + i, *poff, n1)) > 0)
+        *poff += r;
       iunlock(f->inode);
 
       if (r != n1)
@@ -331,6 +371,140 @@ int filewrite(struct file *f, uint64 addr, int n) {
     }
     ret = (i == n ? n : -1);
   }
-  // printf("quit filewrite\n");
   return ret;
-}
\ No newline at end of file
+}
+
+int fileread(struct file *f, uint64 addr, int n) {
+  return readat(f, addr, n, &f->off);
+}
+
+int filewrite(struct file *f, uint64 addr, int n) {
+  return writeat(f, addr, n, &f->off);
+}
+
+// Read into the iovcnt user buffers in iov, holding the inode
+// lock across the whole batch. Stops at the first short read.
+int filereadv(struct file *f, struct iovec *iov, int iovcnt) {
+  int i, r = 0, tot = 0;
+
+  if (f->readable == 0)
+    return -1;
+
+  if (f->type == FD_PIPE) {
+    tot = pipereadv(f->private, iov, iovcnt);
+  } else if (f->type == FD_DEVICE) {
+    for (i = 0; i < iovcnt; i++) {
+      r = devsw[CONSOLE].read(1, (uint64)iov[i].iov_base, iov[i].iov_len);
+      if (r < 0)
+        return tot > 0 ? tot : -1;
+      tot += r;
+      if (r != iov[i].iov_len)
+        break;
+    }
+  } else if (f->type == FD_INODE) {
+    for (i = 0; i < iovcnt; i++)
+      prefault(myproc()->pagetable, (uint64)iov[i].iov_base, iov[i].iov_len);
+    ilockread(f, &f->off);
+    for (i = 0; i < iovcnt; i++) {
+      r = f->inode->op->read(f->inode, 1, (uint64)iov[i].iov_base, f->off, iov[i].iov_len);
+      if (r < 0)
+        break;
+      f->off += r;
+      tot += r;
+      if (r != iov[i].iov_len)
+        break;
+    }
+    iunlock(f->inode);
+    if (r < 0 && tot == 0)
+      return -1;
+  }
+  return tot;
+}
+
+// Write the iovcnt user buffers in iov as one operation,
+// so the file system writes the inode back once per batch.
+int filewritev(struct file *f, struct iovec *iov, int iovcnt) {
+  int i, r, n = 0;
+
+  if (f->writable == 0)
+    return -1;
+
+  for (i = 0; i < iovcnt; i++)
+    n += iov[i].iov_len;
+
+  if (f->type == FD_PIPE || f->type == FD_DEVICE) {
+    for (i = 0; i < iovcnt; i++) {
+      if (f->type == FD_PIPE)
+        r = pipewrite(f->private, (uint64)iov[i].iov_base, iov[i].iov_len);
+      else
+        r = devsw[CONSOLE].write(1, (uint64)iov[i].iov_base, iov[i].iov_len);
+      if (r != iov[i].iov_len)
+        return -1;
+    }
+    return n;
+  } else if (f->type == FD_INODE) {
+    for (i = 0; i < iovcnt; i++)
+      prefault(myproc()->pagetable, (uint64)iov[i].iov_base, iov[i].iov_len);
+    ilock(f->inode);
+    if ((r = f->inode->op->writev(f->inode, 1, iov, iovcnt, f->off)) > 0)
+      f->off += r;
+    iunlock(f->inode);
+    return r == n ? n : -1;
+  }
+  return 0;
+}
+
+// Move up to n bytes between a file and a pipe inside the
+// kernel, at the file's offset. One side must be a pipe and
+// the other a regular file.
+int filesplice(struct file *fin, struct file *fout, int n) {
+  if (fin->readable == 0 || fout->writable == 0 || n < 0)
+    return -1;
+  if (fin->type == FD_INODE && fout->type == FD_PIPE)
+    return filetopipe(fin, fout->private, n);
+  if (fin->type == FD_PIPE && fout->type == FD_INODE)
+    return pipetofile(fin->private, fout, n);
+  return -1;
+}
+
+// Read at offset off without using or moving f->off,
+// so processes sharing f need not coordinate.
+int filepread(struct file *f, uint64 addr, int n, int off) {
+  if (f->type != FD_INODE || off < 0)
+    return -1;
+  return readat(f, addr, n, &off);
+}
+
+// Write at offset off without using or moving f->off.
+int filepwrite(struct file *f, uint64 addr, int n, int off) {
+  if (f->type != FD_INODE || off < 0)
+    return -1;
+  return writeat(f, addr, n, &off);
+}
+
+// Reposition f->off. Offsets past the end of the file are
+// rejected, since the file system cannot write with a gap.
+// Returns the new offset.
+int filelseek(struct file *f, int off, int whence) {
+  long base;
+
+  if (f->type != FD_INODE)
+    return -1;
+  ilock(f->inode);
+  if (whence == SEEK_SET)
+    base = 0;
+  else if (whence == SEEK_CUR)
+    base = f->off;
+  else if (whence == SEEK_END)
+    base = f->inode->size;
+  else
+    base = -1;
+  // in 64 bits, so base + off cannot overflow.
+  if (base < 0 || base + off < 0 || base + off > f->inode->size) {
+    iunlock(f->inode);
+    return -1;
+  }
+  f->off = base + off;
+  iunlock(f->inode);
+  return f->off;
+}
@@ -4,6 +4,8 @@
 #include "stat.h"
 #include "types.h"
 
+struct iovec;
+
 struct filesystem_type {
   const char *type;
   struct filesystem_operations *op;
@@ -53,12 +55,25 @@ struct inode {
   uint inum;
   // Reference count (in memory)
   int ref;
-  // protects everything below here
-  struct sleeplock lock;
+  // Executable MAP_PRIVATE areas (program text) mapping
+  // this file. They map the cached pages themselves, so
+  // writes and truncation are refused while it is nonzero.
+  int ntext;
+  // protects everything below here; held shared by
+  // readers (see ilockshared()), exclusively by writers.
+  // A directory is locked before anything beneath it; two
+  // inodes where neither is above the other are locked
+  // lower inum first.
+  struct rwsleeplock lock;
+  // protects the pages tree against concurrent pcget()s
+  // by readers sharing lock
+  struct spinlock pagelock;
   short type;
   uint dev;
   uint size;
   short nlink;
+  // Cached file pages; see pagecache.c.
+  void **pages;
   void *private;                                                                                                                                                                                                           
 };
 
@@ -118,6 +133,19 @@ struct filesystem_operations {
   // Writes to the file.
   // Linux: file_operations->write
   int (*write) (struct inode *ino, char src_is_user, uint64 src, uint off, uint n);
+  // Writes iovcnt buffers to consecutive offsets starting at off,
+  // as one operation. The iov array itself is in kernel memory.
+  // Linux: file_operations->write_iter
+  int (*writev) (struct inode *ino, char src_is_user, struct iovec *iov, int iovcnt, uint off);
+  // Copies n bytes from src at srcoff to dst at dstoff within the
+  // filesystem, without a bounce buffer. Both inodes are locked
+  // by the caller and distinct. Optional.
+  // Linux: file_operations->copy_file_range
+  int (*copy_range) (struct inode *src, uint srcoff, struct inode *dst, uint dstoff, uint n);
+  // Reads page pgno of a regular file into the page cache page
+  // at pa, which is zeroed. The inode is locked by the caller.
+  // Linux: address_space_operations->read_folio
+  int (*readpage) (struct inode *ino, uint pgno, char *pa);
   // Creates a new file.
   // target is a newly created dentry; target->inode is the actual file.
   // Linux: inode_operations->create
@@ -129,6 +157,12 @@ struct filesystem_operations {
   // Removes a link, and deletes a file if it is the last link.
   // Linux: inode_operations->unlink
   int (*unlink) (struct dentry *d);
+  // Moves a link, replacing the destination if it exists.
+  // old->parent and old->name name the existing link;
+  // new->parent and new->name name where it should go.
+  // Both parents are unlocked and referenced by the caller.
+  // Linux: inode_operations->rename
+  int (*rename) (struct dentry *old, struct dentry *new);
   // look for a file in the directory.
   // Linux: inode_operations->lookup
   struct dentry *(*dirlookup) (struct inode *dir, const char *name);
@@ -4,6 +4,7 @@
 #include "riscv.h"
 #include "defs.h"
 #include "vfs.h"
+struct iovec;
 #define min(a, b) ((a) < (b) ? (a) : (b))
 
 //file.c
@@ -13,6 +14,12 @@ struct file* filedup(struct file *);
 int filestat(struct file *, uint64);
 int fileread(struct file *, uint64, int);
 int filewrite(struct file *, uint64, int);
+int filereadv(struct file *, struct iovec *, int);
+int filewritev(struct file *, struct iovec *, int);
+int filesplice(struct file *, struct file *, int);
+int filepread(struct file *, uint64, int, int);
+int filepwrite(struct file *, uint64, int, int);
+int filelseek(struct file *, int, int);
 
 //fs.c
 void iinit();
@@ -20,6 +27,7 @@ struct inode* iget(uint, uint);
 void vfs_init();
 struct inode* idup(struct inode *);
 void ilock(struct inode *);
+void ilockshared(struct inode *);
 void iunlock(struct inode *);
 void stati(struct inode *, struct stat *);
 void iput(struct inode *);
@@ -28,4 +36,8 @@ int dirlink(struct inode *, char *, uint);
 char* skipelem(char *, char *);
 struct inode* namex(char *, int, char *);
 struct inode* namei(char *);
-struct inode* nameiparent(char *, char *);
\ No newline at end of file
+struct inode* nameiparent(char *, char *);
+
+//pagecache.c
+char* pcget(struct inode *, uint);
+void pcfree(struct inode *);
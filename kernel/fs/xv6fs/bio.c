@@ -4,6 +4,9 @@
 // cached copies of disk block contents.  Caching disk blocks
 // in memory reduces the number of disk reads and also provides
 // a synchronization point for disk blocks used by multiple processes.
+// It holds metadata only: inodes, directories, the free bitmap
+// and indirect blocks. Regular file data lives in the page
+// cache (pagecache.c) and goes to the disk a page at a time.
 //
 // Interface:
 // * To get a buffer for a particular disk block, call bread.
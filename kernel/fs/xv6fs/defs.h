@@ -3,6 +3,7 @@
 #include "types.h"
 #include "fs/vfs.h"
 struct stat;
+struct iovec;
 struct xv6fs_file;
 struct xv6fs_inode;
 
@@ -41,9 +42,13 @@ int                 xv6fs_namecmp(const char*, const char*);
 int                 xv6fs_readi(struct inode*, char, uint64, uint, uint);
 // void                xv6fs_stati(struct xv6fs_inode*, struct stat*);
 int                 xv6fs_writei(struct inode*, char, uint64, uint, uint);
+int                 xv6fs_writev(struct inode*, char, struct iovec*, int, uint);
+int                 xv6fs_copyrange(struct inode*, uint, struct inode*, uint, uint);
+int                 xv6fs_readpage(struct inode*, uint, char*);
 void                xv6fs_itrunc(struct inode*);
 int                 xv6fs_create(struct inode *, struct dentry *, short, short, short);
 int                 xv6fs_link(struct dentry *target);
 int                 xv6fs_unlink(struct dentry *d);
+int                 xv6fs_rename(struct dentry *old, struct dentry *new);
 int                 xv6fs_isdirempty (struct inode *dp);
 struct file*        xv6fs_open (struct inode *ip, uint mode);
\ No newline at end of file
@@ -24,12 +24,16 @@
 #include "buf.h"
 #include "file.h"
 #include "xv6_fcntl.h"
+#include "uio.h"
 #include <time.h>
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
 // there should be one superblock per disk device, but we run with
 // only one device
 struct xv6fs_super_block sb;
+// serializes renames, so that the directory tree cannot
+// change shape while rename checks for cycles.
+static struct sleeplock renamelock;
 void readblock(struct inode *ip);
 void xv6fs_fileclose(struct file *f);
 
@@ -45,9 +49,13 @@ struct filesystem_operations xv6fs_op = {
     .close = xv6fs_fileclose,
     .read = xv6fs_readi,
     .write = xv6fs_writei,
+    .writev = xv6fs_writev,
+    .copy_range = xv6fs_copyrange,
+    .readpage = xv6fs_readpage,
     .create = xv6fs_create,
     .link = xv6fs_link,
     .unlink = xv6fs_unlink,
+    .rename = xv6fs_rename,
     .dirlookup = xv6fs_dirlookup,
     // .release_dentry = xv6_release_dentry,
     .isdirempty = xv6fs_isdirempty,
@@ -101,6 +109,7 @@ xv6fs_fsinit() {
   readsb(1, &sb);
   if(sb.magic != FSMAGIC)
     panic("invalid file system");
+  initsleeplock(&renamelock, "rename");
   // printf("out fsinit\n");
 }
 
@@ -293,10 +302,105 @@ xv6fs_itrunc(struct inode *ip)
 
   ip->size = 0;
   xv6fs_iupdate(ip);
+  // shared mappings keep the old pages; see pagecache.c.
+  pcfree(ip);
   // printf("out itrunc\n");
 }
 
 
+// Read or write the n consecutive blocks of a page at pa
+// whose disk addresses are addrs[], straight between the
+// page and the disk, one request per run of adjacent blocks.
+static void
+pagerw(uint *addrs, int n, char *pa, int write)
+{
+  int i, j;
+
+  for(i = 0; i < n; i = j){
+    for(j = i + 1; j < n && addrs[j] == addrs[j-1] + 1; j++)
+      ;
+    virtio_disk_rwblocks(addrs[i], pa + i*BSIZE, j - i, write);
+  }
+}
+
+// Fill page pgno of regular file ip for the page cache.
+// Blocks past the end of the file are left alone; the
+// page cache hands out zeroed pages.
+// Caller must hold ip->lock.
+int
+xv6fs_readpage(struct inode *ip, uint pgno, char *pa)
+{
+  uint addrs[PGSIZE/BSIZE], bn;
+  int n;
+  struct xv6fs_inode *ipp = ip->private;
+
+  for(n = 0; n < PGSIZE/BSIZE; n++){
+    bn = pgno*(PGSIZE/BSIZE) + n;
+    if(bn >= MAXFILE || bn*BSIZE >= ip->size)
+      break;
+    if((addrs[n] = bmap(ipp, bn)) == 0)
+      return -1;
+  }
+  pagerw(addrs, n, pa, 0);
+  return 0;
+}
+
+// Read a regular file through its page cache, a page at a
+// time. The buffer cache holds only metadata and directories.
+static int
+readpages(struct inode *ip, char user_dst, uint64 dst, uint off, uint n)
+{
+  uint tot, m;
+  char *pg;
+
+  for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
+    if((pg = pcget(ip, off/PGSIZE)) == 0)
+      break;
+    m = min(n - tot, PGSIZE - off%PGSIZE);
+    if(either_copyout(user_dst, dst, pg + (off % PGSIZE), m) == -1)
+      return -1;
+  }
+  return tot;
+}
+
+// Write a regular file through its page cache, a page at a
+// time, writing each page's changed blocks straight through
+// to the disk. Running programs map the cached pages of
+// their text, so a file that is program text cannot be
+// written.
+static int
+writepages(struct inode *ip, char user_src, uint64 src, uint off, uint n)
+{
+  uint tot, m, b0, b1, bn, addrs[PGSIZE/BSIZE];
+  char *pg;
+  struct xv6fs_inode *ipp = ip->private;
+
+  if(ip->ntext > 0)
+    return -1;
+
+  for(tot=0; tot<n; tot+=m, off+=m, src+=m){
+    m = min(n - tot, PGSIZE - off%PGSIZE);
+    if((pg = pcget(ip, off/PGSIZE)) == 0)
+      break;
+    // allocate the blocks first, so that a full disk
+    // leaves the page as it was.
+    b0 = (off % PGSIZE) / BSIZE;
+    b1 = (off % PGSIZE + m - 1) / BSIZE;
+    for(bn = b0; bn <= b1; bn++)
+      if((addrs[bn] = bmap(ipp, off/PGSIZE*(PGSIZE/BSIZE) + bn)) == 0)
+        break;
+    if(bn <= b1)
+      break;
+    if(either_copyin(pg + (off % PGSIZE), user_src, src, m) == -1)
+      break;
+    pagerw(addrs + b0, b1 - b0 + 1, pg + b0*BSIZE, 1);
+  }
+
+  if(off > ip->size)
+    ip->size = off;
+  return tot;
+}
+
 // Read data from inode.
 // Caller must hold ip->lock.
 // If user_dst==1, then dst is a user virtual address;
@@ -311,6 +415,8 @@ xv6fs_readi(struct inode *ip, char user_dst, uint64 dst, uint off, uint n)
     return 0;
   if(off + n > ip->size)
     n = ip->size - off;
+  if(ip->type == T_FILE)
+    return readpages(ip, user_dst, dst, off, n);
 
   for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
     uint addr = bmap(ipp, off/BSIZE);
@@ -328,17 +434,11 @@ xv6fs_readi(struct inode *ip, char user_dst, uint64 dst, uint off, uint n)
   return tot;
 }
 
-// Write data to inode.
-// Caller must hold ip->lock.
-// If user_src==1, then src is a user virtual address;
-// otherwise, src is a kernel address.
-// Returns the number of bytes successfully written.
-// If the return value is less than the requested n,
-// there was an error of some kind.
-int
-xv6fs_writei(struct inode *ip, char user_src, uint64 src, uint off, uint n)
+// Write data to inode without writing the inode back;
+// the caller must call xv6fs_iupdate() afterwards.
+static int
+writei(struct inode *ip, char user_src, uint64 src, uint off, uint n)
 {
-  // printf("in writei\n");
   uint tot, m;
   struct buf *bp;
   struct xv6fs_inode* ipp=ip->private;
@@ -346,6 +446,8 @@ xv6fs_writei(struct inode *ip, char user_src, uint64 src, uint off, uint n)
     return -1;
   if(off + n > MAXFILE*BSIZE)
     return -1;
+  if(ip->type == T_FILE)
+    return writepages(ip, user_src, src, off, n);
 
   for(tot=0; tot<n; tot+=m, off+=m, src+=m){
     uint addr = bmap(ipp, off/BSIZE);
@@ -363,15 +465,86 @@ xv6fs_writei(struct inode *ip, char user_src, uint64 src, uint off, uint n)
 
   if(off > ip->size)
     ip->size = off;
+  return tot;
+}
+
+// Write data to inode.
+// Caller must hold ip->lock.
+// If user_src==1, then src is a user virtual address;
+// otherwise, src is a kernel address.
+// Returns the number of bytes successfully written.
+// If the return value is less than the requested n,
+// there was an error of some kind.
+int
+xv6fs_writei(struct inode *ip, char user_src, uint64 src, uint off, uint n)
+{
+  // printf("in writei\n");
+  int tot = writei(ip, user_src, src, off, n);
+  if(tot < 0)
+    return -1;
 
   // write the i-node back to disk even if the size didn't change
-  // because the loop above might have called bmap() and added a new
+  // because writei() might have called bmap() and added a new
   // block to ip->addrs[].
   xv6fs_iupdate(ip);
   // printf("out writei\n");
   return tot;
 }
 
+// Write the iovcnt buffers in iov to consecutive offsets
+// starting at off, writing the inode back once for the whole
+// batch rather than once per buffer.
+// Caller must hold ip->lock.
+// Returns the number of bytes successfully written.
+int
+xv6fs_writev(struct inode *ip, char user_src, struct iovec *iov, int iovcnt, uint off)
+{
+  int i, r, tot = 0;
+
+  for(i = 0; i < iovcnt; i++){
+    r = writei(ip, user_src, (uint64)iov[i].iov_base, off + tot, iov[i].iov_len);
+    if(r < 0)
+      break;
+    tot += r;
+    if(r != iov[i].iov_len)
+      break;
+  }
+  xv6fs_iupdate(ip);
+  return tot;
+}
+
+// Copy n bytes of src at srcoff to dst at dstoff, straight
+// from src's cached pages into dst's, without a bounce buffer.
+// Caller must hold both ip->locks; src and dst must differ.
+// Returns the number of bytes copied, or -1 if dstoff is
+// beyond the end of dst or dst is program text.
+int
+xv6fs_copyrange(struct inode *src, uint srcoff, struct inode *dst, uint dstoff, uint n)
+{
+  uint tot, m;
+  char *pg;
+
+  if(srcoff > src->size || srcoff + n < srcoff)
+    return 0;
+  if(srcoff + n > src->size)
+    n = src->size - srcoff;
+  if(dstoff > dst->size || dstoff + n < dstoff || dstoff + n > MAXFILE*BSIZE)
+    return -1;
+  if(dst->ntext > 0)
+    return -1;
+
+  for(tot=0; tot<n; tot+=m, srcoff+=m, dstoff+=m){
+    if((pg = pcget(src, srcoff/PGSIZE)) == 0)
+      break;
+    m = min(n - tot, PGSIZE - srcoff%PGSIZE);
+    if(writepages(dst, 0, (uint64)(pg + srcoff%PGSIZE), dstoff, m) != m)
+      break;
+  }
+
+  xv6fs_iupdate(dst);
+  return tot;
+}
+
 // Directories
 
 int
@@ -418,6 +591,40 @@ xv6fs_dirlookup(struct inode *dp, const char *name)
   return ret;
 }
 
+// Return the offset of the first free entry in dp,
+// or dp->size if there is none and dp must grow.
+// Caller must hold dp->lock.
+static uint
+emptyslot(struct inode *dp)
+{
+  uint off;
+  struct xv6fs_dentry de;
+
+  for(off = 0; off < dp->size; off += sizeof(de)){
+    if(xv6fs_readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
+      panic("emptyslot read");
+    if(de.inum == 0)
+      break;
+  }
+  return off;
+}
+
+// Write the directory entry (name, inum) at offset off of dp.
+// Caller must hold dp->lock.
+static int
+setent(struct inode *dp, uint off, const char *name, uint inum)
+{
+  struct xv6fs_dentry de;
+
+  memset(&de, 0, sizeof(de));
+  if(name)
+    strncpy(de.name, name, DIRSIZ);
+  de.inum = inum;
+  if(xv6fs_writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
+    return -1;
+  return 0;
+}
+
 int
 xv6fs_link(struct dentry *target)
 {
@@ -426,8 +633,7 @@ xv6fs_link(struct dentry *target)
   char name[DIRSIZ];
   strncpy(name, target->name, DIRSIZ);
   uint inum = *(uint*)(target->private);
-  int off;
-  struct xv6fs_dentry de;
+  uint off;
   struct inode *ip;
   struct dentry* dir_ret = xv6fs_dirlookup(dp, name);
   ip = dir_ret -> inode;
@@ -441,19 +647,8 @@ xv6fs_link(struct dentry *target)
   }
 
   // Look for an empty dentry.
-  for(off = 0; off < dp->size; off += sizeof(de)){
-    if(xv6fs_readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de)){
-      kfree(dir_ret->private);
-      kfree(dir_ret);
-      panic("dirlink read");
-    }
-    if(de.inum == 0)
-      break;
-  }
-
-  strncpy(de.name, name, DIRSIZ);
-  de.inum = inum;
-  if(xv6fs_writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de)){
+  off = emptyslot(dp);
+  if(setent(dp, off, name, inum) < 0){
     kfree(dir_ret->private);
     kfree(dir_ret);
     // printf("out link\n");
@@ -527,6 +722,206 @@ bad:
   // printf("out unlink\n");
   return -1;
 }
+// Is anc equal to dp or one of its ancestors?
+// If so, *below is set to the inum of the directory just
+// beneath anc on the path up from dp (0 if dp is anc).
+// Caller must hold renamelock and no inode locks.
+static int
+isancestor(struct inode *anc, struct inode *dp, uint *below)
+{
+  struct inode *ip, *next;
+  struct dentry *d;
+  uint prev = 0;
+
+  ip = idup(dp);
+  for(;;){
+    if(ip->inum == anc->inum){
+      iput(ip);
+      *below = prev;
+      return 1;
+    }
+    if(ip->inum == ROOTINO){
+      iput(ip);
+      return 0;
+    }
+    ilock(ip);
+    d = xv6fs_dirlookup(ip, "..");
+    iunlock(ip);
+    next = d->inode;
+    kfree(d->private);
+    kfree(d);
+    prev = ip->inum;
+    iput(ip);
+    if(next == 0)
+      return 0;
+    ip = next;
+  }
+}
+
+// Move the link old->parent/old->name to new->parent/new->name.
+// Within one directory the entry is renamed in place; across
+// directories it is written into the new parent and cleared from
+// the old one. An existing destination is replaced by pointing its
+// entry at the source inode, so the new name never goes missing.
+int
+xv6fs_rename(struct dentry *old, struct dentry *new)
+{
+  struct inode *olddp = old->parent, *newdp = new->parent;
+  struct inode *ip = 0, *tp = 0;
+  struct dentry *src = 0, *dst = 0, *dot;
+  uint below = 0, up, srcoff;
+  int nested, anc, iplocked = 0, tplocked = 0, ret = -1;
+
+  if(olddp->dev != newdp->dev)
+    return -1;
+  if(xv6fs_namecmp(old->name, ".") == 0 || xv6fs_namecmp(old->name, "..") == 0 ||
+     xv6fs_namecmp(new->name, ".") == 0 || xv6fs_namecmp(new->name, "..") == 0)
+    return -1;
+
+  acquiresleep(&renamelock);
+
+  // A destination that is an ancestor of the source is not
+  // empty, and locking it below olddp could deadlock with
+  // an unlink() of the directory in between, so refuse it
+  // before taking any locks. Only rename can make a
+  // directory an ancestor, and renamelock keeps that out.
+  ilock(newdp);
+  dst = xv6fs_dirlookup(newdp, new->name);
+  iunlock(newdp);
+  tp = dst->inode;
+  kfree(dst->private);
+  kfree(dst);
+  dst = 0;
+  if(tp){
+    anc = isancestor(tp, olddp, &below);
+    iput(tp);
+    tp = 0;
+    if(anc){
+      releasesleep(&renamelock);
+      return -1;
+    }
+  }
+
+  // Lock the parents ancestor first, the order in which
+  // every other path through the tree takes them, or lower
+  // inum first if neither is above the other (see struct
+  // inode).
+  nested = olddp != newdp && isancestor(olddp, newdp, &below);
+  if(olddp == newdp){
+    ilock(olddp);
+  } else if(nested){
+    ilock(olddp);
+    ilock(newdp);
+  } else if(isancestor(newdp, olddp, &up) || newdp->inum < olddp->inum){
+    ilock(newdp);
+    ilock(olddp);
+  } else {
+    ilock(olddp);
+    ilock(newdp);
+  }
+  if(newdp->nlink < 1)
+    goto out;
+
+  src = xv6fs_dirlookup(olddp, old->name);
+  if((ip = src->inode) == 0)
+    goto out;
+  srcoff = *(uint*)(src->private);
+  // Cannot move a directory beneath itself.
+  if(nested && ip->inum == below)
+    goto out;
+
+  dst = xv6fs_dirlookup(newdp, new->name);
+  tp = dst->inode;
+  if(tp == ip){
+    // Both names already refer to the same inode.
+    ret = 0;
+    goto out;
+  }
+  // Neither of ip and tp is above the other, so lock them
+  // lower inum first, as copy_file_range() does.
+  if(tp && tp->inum < ip->inum){
+    ilock(tp);
+    tplocked = 1;
+  }
+  ilock(ip);
+  iplocked = 1;
+  if(ip->nlink < 1)
+    panic("rename: nlink < 1");
+  if(tp){
+    if(!tplocked){
+      ilock(tp);
+      tplocked = 1;
+    }
+    if(ip->type == T_DIR){
+      if(tp->type != T_DIR || !xv6fs_isdirempty(tp))
+        goto out;
+    } else if(tp->type == T_DIR){
+      goto out;
+    }
+  }
+
+  if(tp){
+    if(setent(newdp, *(uint*)(dst->private), new->name, ip->inum) < 0)
+      goto out;
+  } else if(olddp == newdp){
+    if(setent(olddp, srcoff, new->name, ip->inum) < 0)
+      goto out;
+  } else {
+    if(setent(newdp, emptyslot(newdp), new->name, ip->inum) < 0)
+      goto out;
+  }
+  if((tp || olddp != newdp) && setent(olddp, srcoff, 0, 0) < 0)
+    panic("rename: clear");
+
+  if(ip->type == T_DIR && olddp != newdp){
+    // Re-point ".." at the new parent.
+    dot = xv6fs_dirlookup(ip, "..");
+    if(dot->inode == 0)
+      panic("rename: no ..");
+    iput(dot->inode);
+    if(setent(ip, *(uint*)(dot->private), "..", newdp->inum) < 0)
+      panic("rename: ..");
+    kfree(dot->private);
+    kfree(dot);
+    olddp->nlink--;
+    xv6fs_iupdate(olddp);
+    newdp->nlink++;
+  }
+  if(tp){
+    if(tp->type == T_DIR)
+      newdp->nlink--;  // for tp's ".."
+    tp->nlink--;
+    xv6fs_iupdate(tp);
+  }
+  xv6fs_iupdate(newdp);
+  ret = 0;
+
+out:
+  if(tp){
+    if(tplocked)
+      iunlock(tp);
+    iput(tp);
+  }
+  if(ip){
+    if(iplocked)
+      iunlock(ip);
+    iput(ip);
+  }
+  if(dst){
+    kfree(dst->private);
+    kfree(dst);
+  }
+  if(src){
+    kfree(src->private);
+    kfree(src);
+  }
+  iunlock(olddp);
+  if(newdp != olddp)
+    iunlock(newdp);
+  releasesleep(&renamelock);
+  return ret;
+}
+
 int
 xv6fs_isdirempty (struct inode *dp){
   // printf("in isdirempty\n");
@@ -18,15 +18,55 @@ struct run {
   struct run *next;
 };
 
+// Free pages live in a global pool, kmem, and in a small
+// cache per hart, so most kalloc() and kfree() calls touch
+// only the calling hart's cache. A hart refills its cache
+// from kmem KBATCH pages at a time when it runs dry, and
+// gives KBATCH pages back once it holds 2*KBATCH. Only when
+// kmem is empty too does a hart take from another's cache,
+// so a cache's lock is normally only ever taken by its hart.
+//
+// Each cache also keeps up to KZERO pages that an idle hart
+// has already zeroed (see kzero()), so that kzalloc() can
+// hand out a zeroed page without writing it.
+//
+// Pages are not filled with junk on kalloc() and kfree()
+// unless the kernel is built with KPOISON (make DEBUG=1).
+#define KBATCH 32
+#define KZERO  32
+
 struct {
   struct spinlock lock;
   struct run *freelist;
 } kmem;
 
+struct kcache {
+  struct spinlock lock;
+  struct run *freelist;
+  int n;               // pages on freelist
+  struct run *zeroed;  // zeroed but for the run itself
+  int nzero;           // pages on zeroed
+} kcache[NCPU];
+
+// Number of references to each physical page, so that
+// copy-on-write fork can share pages between page tables.
+// kalloc() returns a page with one reference; kfree()
+// drops one and frees the page when none are left. The
+// counts are updated with atomic instructions, not a lock.
+#define PA2REF(pa) (((uint64)(pa) - KERNBASE) / PGSIZE)
+
+struct {
+  int cnt[(PHYSTOP - KERNBASE) / PGSIZE];
+} kref;
+
 void
 kinit()
 {
+  int i;
+
   initlock(&kmem.lock, "kmem");
+  for(i = 0; i < NCPU; i++)
+    initlock(&kcache[i].lock, "kcache");
   freerange(end, (void*)PHYSTOP);
 }
 
@@ -35,8 +75,68 @@ freerange(void *pa_start, void *pa_end)
 {
   char *p;
   p = (char*)PGROUNDUP((uint64)pa_start);
-  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE)
+  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE){
+    kref.cnt[PA2REF(p)] = 1;
     kfree(p);
+  }
+}
+
+// Move up to n pages from the front of list *from to a list
+// of their own, from *head to *tail. Returns how many moved.
+static int
+ktake(struct run **from, int n, struct run **head, struct run **tail)
+{
+  struct run *r = 0;
+  int i;
+
+  *head = *from;
+  for(i = 0; i < n && *from; i++){
+    r = *from;
+    *from = r->next;
+  }
+  if(r)
+    r->next = 0;
+  *tail = r;
+  return i;
+}
+
+// Refill the cache kc of this hart, from kmem if it has
+// pages and else from another hart's cache, or from any
+// hart's zeroed pages as a last resort. Called with
+// interrupts off and without kc->lock, since taking another
+// hart's lock while holding our own could deadlock.
+// Returns the number of pages added.
+static int
+krefill(struct kcache *kc)
+{
+  struct kcache *o;
+  struct run *head, *tail;
+  int n;
+
+  acquire(&kmem.lock);
+  n = ktake(&kmem.freelist, KBATCH, &head, &tail);
+  release(&kmem.lock);
+  for(o = kcache; n == 0 && o < &kcache[NCPU]; o++){
+    acquire(&o->lock);
+    if(o != kc){
+      n = ktake(&o->freelist, (o->n + 1) / 2, &head, &tail);
+      o->n -= n;
+    }
+    if(n == 0){
+      n = ktake(&o->zeroed, (o->nzero + 1) / 2, &head, &tail);
+      o->nzero -= n;
+    }
+    release(&o->lock);
+  }
+  if(n == 0)
+    return 0;
+
+  acquire(&kc->lock);
+  tail->next = kc->freelist;
+  kc->freelist = head;
+  kc->n += n;
+  release(&kc->lock);
+  return n;
 }
 
 // Free the page of physical memory pointed at by pa,
@@ -46,20 +146,46 @@ freerange(void *pa_start, void *pa_end)
 void
 kfree(void *pa)
 {
-  struct run *r;
+  struct kcache *kc;
+  struct run *r, *head, *tail;
+  int n, left;
 
   if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
     panic("kfree");
 
+  left = __atomic_sub_fetch(&kref.cnt[PA2REF(pa)], 1, __ATOMIC_ACQ_REL);
+  if(left < 0)
+    panic("kfree: ref");
+  if(left > 0)
+    return;
+
+#ifdef KPOISON
   // Fill with junk to catch dangling refs.
   memset(pa, 1, PGSIZE);
+#endif
 
   r = (struct run*)pa;
 
-  acquire(&kmem.lock);
-  r->next = kmem.freelist;
-  kmem.freelist = r;
-  release(&kmem.lock);
+  push_off();
+  kc = &kcache[cpuid()];
+  acquire(&kc->lock);
+  r->next = kc->freelist;
+  kc->freelist = r;
+  kc->n++;
+  n = 0;
+  if(kc->n >= 2*KBATCH){
+    n = ktake(&kc->freelist, KBATCH, &head, &tail);
+    kc->n -= n;
+  }
+  release(&kc->lock);
+  pop_off();
+
+  if(n > 0){
+    acquire(&kmem.lock);
+    tail->next = kmem.freelist;
+    kmem.freelist = head;
+    release(&kmem.lock);
+  }
 }
 
 // Allocate one 4096-byte page of physical memory.
@@ -68,15 +194,112 @@ kfree(void *pa)
 void *
 kalloc(void)
 {
+  struct kcache *kc;
   struct run *r;
 
-  acquire(&kmem.lock);
-  r = kmem.freelist;
-  if(r)
-    kmem.freelist = r->next;
-  release(&kmem.lock);
+  push_off();
+  kc = &kcache[cpuid()];
+  for(;;){
+    acquire(&kc->lock);
+    r = kc->freelist;
+    if(r){
+      kc->freelist = r->next;
+      kc->n--;
+    }
+    release(&kc->lock);
+    if(r || krefill(kc) == 0)
+      break;
+  }
+  pop_off();
 
-  if(r)
+  if(r){
+    __atomic_store_n(&kref.cnt[PA2REF(r)], 1, __ATOMIC_RELAXED);
+#ifdef KPOISON
     memset((char*)r, 5, PGSIZE); // fill with junk
+#endif
+  }
+  return (void*)r;
+}
+
+// Allocate one zeroed page, from this hart's pool of pages
+// that kzero() zeroed ahead of time if it has one.
+// Returns 0 if the memory cannot be allocated.
+void *
+kzalloc(void)
+{
+  struct kcache *kc;
+  struct run *r;
+
+  push_off();
+  kc = &kcache[cpuid()];
+  acquire(&kc->lock);
+  r = kc->zeroed;
+  if(r){
+    kc->zeroed = r->next;
+    kc->nzero--;
+  }
+  release(&kc->lock);
+  pop_off();
+
+  if(r == 0){
+    if((r = kalloc()) != 0)
+      memset((char*)r, 0, PGSIZE);
+    return (void*)r;
+  }
+  r->next = 0;
+  __atomic_store_n(&kref.cnt[PA2REF(r)], 1, __ATOMIC_RELAXED);
   return (void*)r;
 }
+
+// Zero a free page into this hart's pool for kzalloc(), if
+// the pool is not full. Called by the scheduler when it has
+// nothing to run, so the zeroing costs no process any time.
+// Returns 1 if it zeroed a page, 0 if there was nothing to do.
+int
+kzero(void)
+{
+  struct kcache *kc;
+  struct run *r = 0;
+  int full;
+
+  push_off();
+  kc = &kcache[cpuid()];
+  acquire(&kc->lock);
+  full = kc->nzero >= KZERO;
+  if(!full && (r = kc->freelist) != 0){
+    kc->freelist = r->next;
+    kc->n--;
+  }
+  release(&kc->lock);
+  if(!full && r == 0){
+    acquire(&kmem.lock);
+    if((r = kmem.freelist) != 0)
+      kmem.freelist = r->next;
+    release(&kmem.lock);
+  }
+  if(r){
+    memset((char*)r, 0, PGSIZE);
+    acquire(&kc->lock);
+    r->next = kc->zeroed;
+    kc->zeroed = r;
+    kc->nzero++;
+    release(&kc->lock);
+  }
+  pop_off();
+  return r != 0;
+}
+
+// Add a reference to the allocated page pa.
+void
+kdup(void *pa)
+{
+  if(__atomic_fetch_add(&kref.cnt[PA2REF(pa)], 1, __ATOMIC_RELAXED) < 1)
+    panic("kdup");
+}
+
+// Return the number of references to page pa.
+int
+krefcnt(void *pa)
+{
+  return __atomic_load_n(&kref.cnt[PA2REF(pa)], __ATOMIC_ACQUIRE);
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "types.h"
+
+// Spinlock contention statistics, as returned by lockstat().
+// Both the kernel and user programs use this header file.
+//
+// Locks are counted by name, so all the "proc" locks, say,
+// share one entry. Times are in ticks of the time CSR,
+// which qemu runs at 10 MHz.
+
+#define NLOCKSTAT 32  // most lock names counted
+
+struct lockstat {
+  char name[16];
+  uint ninit;         // initlock() calls with this name
+  uint pad;
+  uint64 nacquire;    // times acquired
+  uint64 nspin;       // times a waiter polled the lock
+  uint64 maxhold;     // longest time held
+};
@@ -13,3 +13,9 @@
 #define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
 #define FSSIZE       2000  // size of file system in blocks
 #define MAXPATH      128   // maximum file path name
+#define IOV_MAX      16    // max iovecs per readv/writev
+#define NVMA         16    // file-backed memory areas per process
+#define HZ           10    // clock ticks per second
+#define NPRIO        3     // scheduling priority levels
+#define QUANTUM      1     // ticks per time slice at the top level
+#define AGETICKS     10    // ticks between priority boosts
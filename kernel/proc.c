@@ -10,6 +10,44 @@ struct cpu cpus[NCPU];
 
 struct proc proc[NPROC];
 
+// Per-CPU queues of RUNNABLE processes, linked through
+// p->rqnext. A process is only ever on one queue, and only
+// while RUNNABLE; scheduler() takes it off before running it.
+//
+// Each queue is a multi-level feedback queue: one FIFO list
+// per priority level, 0 highest. A process that uses up its
+// time slice drops a level, and gets a longer slice there;
+// one that sleeps goes back up to its base level, p->nice,
+// so I/O-bound processes run ahead of CPU-bound ones.
+// runqage() lifts everyone back up every AGETICKS ticks, so
+// that the bottom level does not starve.
+struct runq {
+  struct spinlock lock;
+  struct proc *head[NPRIO];
+  struct proc *tail[NPRIO];
+} runq[NCPU];
+
+#define SLICE(prio) (QUANTUM << (prio))  // ticks per slice at level prio
+
+// Sleeping processes, hashed by wait channel and linked
+// through p->wqnext, so wakeup() looks only at processes
+// that may be waiting on its channel. A process stays on its
+// queue from sleep() until it runs again and takes itself
+// off. Lock order: wait queue lock, then p->lock.
+#define NWAITQ 64
+struct waitq {
+  struct spinlock lock;
+  struct proc *head;
+} waitq[NWAITQ];
+
+static struct waitq*
+chanq(void *chan)
+{
+  uint64 x = (uint64)chan;
+
+  return &waitq[((x >> 3) ^ (x >> 12)) % NWAITQ];
+}
+
 struct proc *initproc;
 
 int nextpid = 1;
@@ -17,9 +55,14 @@ struct spinlock pid_lock;
 
 extern void forkret(void);
 static void freeproc(struct proc *p);
+static void setrunnable(struct proc *p);
+static void kickidle(int id);
+static void runqappend(struct runq *rq, struct proc *p);
 
 extern char trampoline[]; // trampoline.S
 
+extern uint64 asidmax;    // vm.c
+
 // helps ensure that wakeups of wait()ing
 // parents are not lost. helps obey the
 // memory model when using p->parent.
@@ -51,10 +94,16 @@ procinit(void)
   
   initlock(&pid_lock, "nextpid");
   initlock(&wait_lock, "wait_lock");
+  for(int i = 0; i < NCPU; i++)
+    initlock(&runq[i].lock, "runq");
+  for(int i = 0; i < NWAITQ; i++)
+    initlock(&waitq[i].lock, "waitq");
   for(p = proc; p < &proc[NPROC]; p++) {
       initlock(&p->lock, "proc");
       p->state = UNUSED;
       p->kstack = KSTACK((int) (p - proc));
+      // one ASID per slot, if the hardware has enough.
+      p->asid = asidmax >= NPROC ? (p - proc) + 1 : 0;
   }
 }
 
@@ -124,6 +173,10 @@ allocproc(void)
 found:
   p->pid = allocpid();
   p->state = USED;
+  p->tlbcpu = -1;
+  p->nice = 0;
+  p->prio = 0;
+  p->ticks = 0;
 
   // Allocate a trapframe page.
   if((p->trapframe = (struct trapframe *)kalloc()) == 0){
@@ -158,8 +211,10 @@ freeproc(struct proc *p)
   if(p->trapframe)
     kfree((void*)p->trapframe);
   p->trapframe = 0;
-  if(p->pagetable)
+  if(p->pagetable){
+    uringfree(p);
     proc_freepagetable(p->pagetable, p->sz);
+  }
   p->pagetable = 0;
   p->sz = 0;
   p->pid = 0;
@@ -248,12 +303,14 @@ userinit(void)
 
   safestrcpy(p->name, "initcode", sizeof(p->name));
   p->cwd = namei("/");
-  p->state = RUNNABLE;
+  setrunnable(p);
 
   release(&p->lock);
 }
 
 // Grow or shrink user memory by n bytes.
+// Growing only reserves the addresses; vmfault() allocates
+// each page when it is first touched.
 // Return 0 on success, -1 on failure.
 int
 growproc(int n)
@@ -263,9 +320,9 @@ growproc(int n)
 
   sz = p->sz;
   if(n > 0){
-    if((sz = uvmalloc(p->pagetable, sz, sz + n, PTE_W)) == 0) {
+    if(sz + n > vmatop(p))
       return -1;
-    }
+    sz += n;
   } else if(n < 0){
     sz = uvmdealloc(p->pagetable, sz, sz + n);
   }
@@ -293,7 +350,13 @@ fork(void)
     release(&np->lock);
     return -1;
   }
+  // set now, so freeproc() unmaps the copy if vmadup() fails.
   np->sz = p->sz;
+  if(vmadup(np, p) < 0){
+    freeproc(np);
+    release(&np->lock);
+    return -1;
+  }
 
   // copy saved user registers.
   *(np->trapframe) = *(p->trapframe);
@@ -309,6 +372,9 @@ fork(void)
 
   safestrcpy(np->name, p->name, sizeof(p->name));
 
+  np->nice = p->nice;
+  np->prio = p->nice;
+
   pid = np->pid;
 
   release(&np->lock);
@@ -318,7 +384,7 @@ fork(void)
   release(&wait_lock);
 
   acquire(&np->lock);
-  np->state = RUNNABLE;
+  setrunnable(np);
   release(&np->lock);
 
   return pid;
@@ -361,6 +427,7 @@ exit(int status)
 
   iput(p->cwd);
   p->cwd = 0;
+  vmaclose(p);
 
   acquire(&wait_lock);
 
@@ -391,6 +458,10 @@ wait(uint64 addr)
   int havekids, pid;
   struct proc *p = myproc();
 
+  // copyout() below runs with locks held.
+  if(addr != 0)
+    prefault(p->pagetable, addr, sizeof(int));
+
   acquire(&wait_lock);
 
   for(;;){
@@ -431,10 +502,138 @@ wait(uint64 addr)
   }
 }
 
+// Mark p RUNNABLE and queue it on the run queue of the
+// hart it last ran on, whose caches and TLB may still hold
+// its state, or on this hart's for a new process.
+// Caller must hold p->lock.
+static void
+setrunnable(struct proc *p)
+{
+  int id = p->tlbcpu >= 0 ? p->tlbcpu : cpuid();
+  struct runq *rq = &runq[id];
+
+  p->state = RUNNABLE;
+  acquire(&rq->lock);
+  runqappend(rq, p);
+  release(&rq->lock);
+  kickidle(id);
+}
+
+// Add p at the tail of its level of rq.
+// Caller must hold rq->lock.
+static void
+runqappend(struct runq *rq, struct proc *p)
+{
+  p->rqnext = 0;
+  if(rq->tail[p->prio])
+    rq->tail[p->prio]->rqnext = p;
+  else
+    rq->head[p->prio] = p;
+  rq->tail[p->prio] = p;
+}
+
+// A process was just queued on hart id's run queue; wake
+// id if it is idle in scheduler(), or else any idle hart,
+// which will steal the process. Pairs with the check of
+// the queues after scheduler() sets c->idle.
+static void
+kickidle(int id)
+{
+  int i;
+
+  __sync_synchronize();
+  if(cpus[id].idle){
+    ipi(id);
+    return;
+  }
+  for(i = 0; i < NCPU; i++){
+    if(cpus[i].idle){
+      ipi(i);
+      return;
+    }
+  }
+}
+
+// Return 1 if rq has a process queued at a level above
+// prio. Checks without the lock, so it may be stale.
+static int
+runqabove(struct runq *rq, int prio)
+{
+  for(int i = 0; i < prio; i++)
+    if(__atomic_load_n(&rq->head[i], __ATOMIC_RELAXED))
+      return 1;
+  return 0;
+}
+
+// Take the first process of the highest non-empty level of
+// rq off it, or return 0 if rq is empty. Checks without the
+// lock first, so harts looking for work to steal do not
+// fight over it.
+static struct proc*
+runqget(struct runq *rq)
+{
+  struct proc *p = 0;
+  int prio;
+
+  if(!runqabove(rq, NPRIO))
+    return 0;
+  acquire(&rq->lock);
+  for(prio = 0; prio < NPRIO; prio++){
+    if((p = rq->head[prio]) != 0){
+      rq->head[prio] = p->rqnext;
+      if(rq->head[prio] == 0)
+        rq->tail[prio] = 0;
+      p->rqnext = 0;
+      break;
+    }
+  }
+  release(&rq->lock);
+  return p;
+}
+
+// Move every queued process below its base level back up
+// to it. Called by clockintr() every AGETICKS ticks.
+void
+runqage(void)
+{
+  struct runq *rq;
+  struct proc *p, *next;
+  int prio;
+
+  for(rq = runq; rq < &runq[NCPU]; rq++){
+    acquire(&rq->lock);
+    for(prio = 1; prio < NPRIO; prio++){
+      p = rq->head[prio];
+      rq->head[prio] = rq->tail[prio] = 0;
+      for(; p; p = next){
+        next = p->rqnext;
+        p->prio = p->nice;
+        p->ticks = 0;
+        runqappend(rq, p);
+      }
+    }
+    release(&rq->lock);
+  }
+}
+
+// Take a process off this hart's run queue, or steal one
+// from another hart's. Returns 0 if there is none.
+static struct proc*
+runqpick(int id)
+{
+  struct proc *p;
+
+  p = runqget(&runq[id]);
+  for(int i = 1; p == 0 && i < NCPU; i++)
+    p = runqget(&runq[(id + i) % NCPU]);
+  return p;
+}
+
 // Per-CPU process scheduler.
 // Each CPU calls scheduler() after setting itself up.
 // Scheduler never returns.  It loops, doing:
-//  - choose a process to run.
+//  - take a process off this CPU's run queue, or steal
+//    one from another CPU's if this one's is empty.
 //  - swtch to start running that process.
 //  - eventually that process transfers control
 //    via swtch back to the scheduler.
@@ -443,28 +642,59 @@ scheduler(void)
 {
   struct proc *p;
   struct cpu *c = mycpu();
+  int id = cpuid();
   
   c->proc = 0;
   for(;;){
     // Avoid deadlock by ensuring that devices can interrupt.
     intr_on();
 
-    for(p = proc; p < &proc[NPROC]; p++) {
-      acquire(&p->lock);
-      if(p->state == RUNNABLE) {
-        // Switch to chosen process.  It is the process's job
-        // to release its lock and then reacquire it
-        // before jumping back to us.
-        p->state = RUNNING;
-        c->proc = p;
-        swtch(&c->context, &p->context);
-
-        // Process is done running for now.
-        // It should have changed its p->state before coming back.
-        c->proc = 0;
-      }
-      release(&p->lock);
+    if((p = runqpick(id)) == 0){
+      // Nothing to run: zero a page for kzalloc() if the
+      // pool is short, and look again.
+      if(kzero())
+        continue;
+      // Still nothing: wait for an interrupt instead of
+      // spinning. setrunnable() sends an ipi() to an idle
+      // hart. Interrupts are off from the final check until
+      // wfi, which still wakes on a pending interrupt, so an
+      // ipi() sent in between is not lost.
+      intr_off();
+      c->idle = 1;
+      __sync_synchronize();
+      if((p = runqpick(id)) == 0)
+        asm volatile("wfi");
+      c->idle = 0;
+      if(p == 0)
+        continue;
+    }
+
+    // Once off its queue, p is ours: only a RUNNABLE process
+    // is queued, and nothing else changes a RUNNABLE process's
+    // state. Its lock may still be held by the hart that just
+    // switched away from it.
+    acquire(&p->lock);
+    if(p->state != RUNNABLE)
+      panic("scheduler: not runnable");
+    // Switch to chosen process.  It is the process's job
+    // to release its lock and then reacquire it
+    // before jumping back to us.
+    p->state = RUNNING;
+    c->proc = p;
+    // This hart's TLB may hold stale entries for p's ASID,
+    // from before p last ran elsewhere or from an earlier
+    // process in this slot; page table changes flush only
+    // the hart that made them.
+    if(p->tlbcpu != id){
+      sfence_vma_asid(p->asid);
+      p->tlbcpu = id;
     }
+    swtch(&c->context, &p->context);
+
+    // Process is done running for now.
+    // It should have changed its p->state before coming back.
+    c->proc = 0;
+    release(&p->lock);
   }
 }
 
@@ -495,13 +725,54 @@ sched(void)
   mycpu()->intena = intena;
 }
 
+// Called on each timer interrupt while the current process
+// runs. Charges it the tick; once it has used up its slice,
+// it drops a level and yields. It also yields early if a
+// process of a higher level is waiting on this hart.
+void
+preempt(void)
+{
+  struct proc *p = myproc();
+
+  if(++p->ticks >= SLICE(p->prio)){
+    if(p->prio < NPRIO-1)
+      p->prio++;
+    p->ticks = 0;
+    yield();
+  } else if(runqabove(&runq[p->tlbcpu], p->prio)){
+    yield();
+  }
+}
+
+// Add inc to the current process's nice value, its base
+// priority level, clamped to 0 (highest) .. NPRIO-1.
+// Returns the new nice value.
+int
+nice(int inc)
+{
+  struct proc *p = myproc();
+  int n;
+
+  acquire(&p->lock);
+  n = p->nice + inc;
+  if(n < 0)
+    n = 0;
+  if(n > NPRIO-1)
+    n = NPRIO-1;
+  p->nice = n;
+  if(p->prio < n)
+    p->prio = n;
+  release(&p->lock);
+  return n;
+}
+
 // Give up the CPU for one scheduling round.
 void
 yield(void)
 {
   struct proc *p = myproc();
   acquire(&p->lock);
-  p->state = RUNNABLE;
+  setrunnable(p);
   sched();
   release(&p->lock);
 }
@@ -534,6 +805,8 @@ void
 sleep(void *chan, struct spinlock *lk)
 {
   struct proc *p = myproc();
+  struct waitq *wq = chanq(chan);
+  struct proc **pp;
   
   // Must acquire p->lock in order to
   // change p->state and then call sched.
@@ -541,40 +814,72 @@ sleep(void *chan, struct spinlock *lk)
   // guaranteed that we won't miss any wakeup
   // (wakeup locks p->lock),
   // so it's okay to release lk.
+  // The wait queue lock comes first, so that wakeup()
+  // can hold it while it locks each waiter.
+
+  // We join the wait queue before releasing lk, so a waker
+  // that takes lk after us finds the queue non-empty.
 
+  acquire(&wq->lock);
   acquire(&p->lock);  //DOC: sleeplock1
-  release(lk);
 
   // Go to sleep.
   p->chan = chan;
   p->state = SLEEPING;
+  p->wqnext = wq->head;
+  wq->head = p;
+
+  release(lk);
+  release(&wq->lock);
 
   sched();
 
   // Tidy up.
   p->chan = 0;
+  release(&p->lock);
+
+  // wakeup() or kill() made us RUNNABLE but left us
+  // on the wait queue; take ourselves off.
+  acquire(&wq->lock);
+  for(pp = &wq->head; *pp; pp = &(*pp)->wqnext){
+    if(*pp == p){
+      *pp = p->wqnext;
+      break;
+    }
+  }
+  release(&wq->lock);
 
   // Reacquire original lock.
-  release(&p->lock);
   acquire(lk);
 }
 
 // Wake up all processes sleeping on chan.
-// Must be called without any p->lock.
+// Must be called without any p->lock, and holding the
+// lock that sleepers on chan pass to sleep().
 void
 wakeup(void *chan)
 {
+  struct waitq *wq = chanq(chan);
   struct proc *p;
 
-  for(p = proc; p < &proc[NPROC]; p++) {
+  // Unlocked check: a sleeper joins the queue before it
+  // releases the condition's lock, which our caller holds.
+  if(__atomic_load_n(&wq->head, __ATOMIC_RELAXED) == 0)
+    return;
+  acquire(&wq->lock);
+  for(p = wq->head; p; p = p->wqnext) {
     if(p != myproc()){
       acquire(&p->lock);
       if(p->state == SLEEPING && p->chan == chan) {
-        p->state = RUNNABLE;
+        // it gave up the CPU to wait; back to its base level.
+        p->prio = p->nice;
+        p->ticks = 0;
+        setrunnable(p);
       }
       release(&p->lock);
     }
   }
+  release(&wq->lock);
 }
 
 // Kill the process with the given pid.
@@ -591,7 +896,7 @@ kill(int pid)
       p->killed = 1;
       if(p->state == SLEEPING){
         // Wake process from sleep().
-        p->state = RUNNABLE;
+        setrunnable(p);
       }
       release(&p->lock);
       return 0;
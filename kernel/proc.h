@@ -32,6 +32,7 @@ struct cpu {
   struct context context;     // swtch() here to enter scheduler().
   int noff;                   // Depth of push_off() nesting.
   int intena;                 // Were interrupts enabled before push_off()?
+  int idle;                   // In wfi in scheduler(), to be woken by ipi().
 };
 
 extern struct cpu cpus[NCPU];
@@ -87,6 +88,19 @@ struct trapframe {
   /* 280 */ uint64 t6;
 };
 
+// A range of user memory backed by a file, a program
+// segment or an mmap(). Pages are read in from the file as
+// they are first touched; see vmafill().
+struct vma {
+  struct inode *ip;   // backing file, or 0 if the slot is free
+  uint64 start;       // page-aligned first address
+  uint64 end;         // first address past the area
+  int perm;           // PTE_W and PTE_X, as for uvmalloc()
+  int flags;          // MAP_SHARED or MAP_PRIVATE
+  uint off;           // file offset of start
+  uint filesz;        // bytes backed by the file; the rest is zero
+};
+
 enum procstate { UNUSED, USED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
 // Per-process state
@@ -112,4 +126,13 @@ struct proc {
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
+  struct uring *uring;         // Rings mapped at URING, or 0
+  struct vma vma[NVMA];        // File-backed memory areas
+  int asid;                    // Address space ID in satp, or 0
+  int tlbcpu;                  // Hart that last ran it, or -1
+  struct proc *rqnext;         // Next on its run queue (runq lock)
+  int nice;                    // Base priority level, 0 highest
+  int prio;                    // Current priority level
+  int ticks;                   // Ticks used of its slice at prio
+  struct proc *wqnext;         // Next on its wait queue (waitq lock)
 };
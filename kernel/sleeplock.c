@@ -9,6 +9,35 @@
 #include "proc.h"
 #include "sleeplock.h"
 
+// How many times a waiter checks a lock whose holder is
+// running before it gives up and sleeps.
+#define SLEEPSPIN 1000
+
+// A process asleep in acquiresleep(), queued on the lock.
+struct sleepwaiter {
+  struct proc *p;
+  int granted;       // releasesleep() has handed us the lock
+  struct sleepwaiter *next;
+};
+
+// Spin while the lock is held (*locked) by a process (*owner)
+// running on another hart, which will likely release it
+// sooner than a sleep and wakeup would take. Gives up after
+// SLEEPSPIN checks, or as soon as the holder stops running.
+static void
+spinheld(uint *locked, struct proc **owner)
+{
+  struct proc *p = myproc(), *o;
+
+  for(int i = 0; i < SLEEPSPIN; i++){
+    if(__atomic_load_n(locked, __ATOMIC_RELAXED) == 0)
+      return;
+    o = __atomic_load_n(owner, __ATOMIC_RELAXED);
+    if(o == 0 || o == p || __atomic_load_n(&o->state, __ATOMIC_RELAXED) != RUNNING)
+      return;
+  }
+}
+
 void
 initsleeplock(struct sleeplock *lk, char *name)
 {
@@ -16,27 +45,61 @@ initsleeplock(struct sleeplock *lk, char *name)
   lk->name = name;
   lk->locked = 0;
   lk->pid = 0;
+  lk->owner = 0;
+  lk->head = lk->tail = 0;
 }
 
+// Spin briefly if the holder is running, else sleep in a
+// FIFO queue. releasesleep() hands the lock straight to the
+// first waiter and wakes only that one.
 void
 acquiresleep(struct sleeplock *lk)
 {
+  struct proc *p = myproc();
+  struct sleepwaiter w;
+
+  spinheld(&lk->locked, &lk->owner);
   acquire(&lk->lk);
-  while (lk->locked) {
-    sleep(lk, &lk->lk);
+  if(lk->locked){
+    w.p = p;
+    w.granted = 0;
+    w.next = 0;
+    if(lk->tail)
+      lk->tail->next = &w;
+    else
+      lk->head = &w;
+    lk->tail = &w;
+    while(!w.granted)
+      sleep(&w, &lk->lk);
+    // releasesleep() made us the holder.
+  } else {
+    lk->locked = 1;
+    lk->pid = p->pid;
+    lk->owner = p;
   }
-  lk->locked = 1;
-  lk->pid = myproc()->pid;
   release(&lk->lk);
 }
 
 void
 releasesleep(struct sleeplock *lk)
 {
+  struct sleepwaiter *w;
+
   acquire(&lk->lk);
-  lk->locked = 0;
-  lk->pid = 0;
-  wakeup(lk);
+  if((w = lk->head) != 0){
+    // hand off; lk stays locked.
+    lk->head = w->next;
+    if(lk->head == 0)
+      lk->tail = 0;
+    lk->pid = w->p->pid;
+    lk->owner = w->p;
+    w->granted = 1;
+    wakeup(w);
+  } else {
+    lk->locked = 0;
+    lk->pid = 0;
+    lk->owner = 0;
+  }
   release(&lk->lk);
 }
 
@@ -51,5 +114,67 @@ holdingsleep(struct sleeplock *lk)
   return r;
 }
 
+void
+initrwsleeplock(struct rwsleeplock *lk, char *name)
+{
+  initlock(&lk->lk, "rw sleep lock");
+  lk->name = name;
+  lk->locked = 0;
+  lk->readers = 0;
+  lk->wwait = 0;
+  lk->pid = 0;
+  lk->owner = 0;
+}
 
+// Acquire lk shared if shared is set, else exclusively.
+// Waiting writers hold off new readers, so a stream of
+// readers cannot starve a writer. Spins first while a
+// writer holds lk and is running, like acquiresleep().
+void
+acquirerw(struct rwsleeplock *lk, int shared)
+{
+  spinheld(&lk->locked, &lk->owner);
+  acquire(&lk->lk);
+  if(shared){
+    while(lk->locked || lk->wwait)
+      sleep(lk, &lk->lk);
+    lk->readers++;
+  } else {
+    lk->wwait++;
+    while(lk->locked || lk->readers)
+      sleep(lk, &lk->lk);
+    lk->wwait--;
+    lk->locked = 1;
+    lk->pid = myproc()->pid;
+    lk->owner = myproc();
+  }
+  release(&lk->lk);
+}
 
+// Release lk, in whichever mode it is held.
+void
+releaserw(struct rwsleeplock *lk)
+{
+  acquire(&lk->lk);
+  if(lk->locked){
+    lk->locked = 0;
+    lk->pid = 0;
+    lk->owner = 0;
+    wakeup(lk);
+  } else if(--lk->readers == 0){
+    wakeup(lk);
+  }
+  release(&lk->lk);
+}
+
+// Is lk held exclusively by this process, or shared by anyone?
+int
+holdingrw(struct rwsleeplock *lk)
+{
+  int r;
+
+  acquire(&lk->lk);
+  r = (lk->locked && lk->pid == myproc()->pid) || lk->readers > 0;
+  release(&lk->lk);
+  return r;
+}
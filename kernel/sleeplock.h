@@ -3,13 +3,33 @@
 #include "types.h"
 #include "spinlock.h"
 
+struct proc;
+struct sleepwaiter;
+
 // Long-term locks for processes
 struct sleeplock {
   uint locked;       // Is the lock held?
   struct spinlock lk; // spinlock protecting this sleep lock
+  struct proc *owner; // Process holding lock, for spinning waiters
+  struct sleepwaiter *head; // FIFO of sleeping waiters
+  struct sleepwaiter *tail;
   
   // For debugging:
   char *name;        // Name of lock.
   int pid;           // Process holding lock
 };
 
+// Long-term reader/writer locks: held shared by any number
+// of readers, or exclusively by one writer.
+struct rwsleeplock {
+  uint locked;       // Is the lock held exclusively?
+  int readers;       // Number of shared holders
+  int wwait;         // Writers waiting; new readers wait too
+  struct spinlock lk; // spinlock protecting this sleep lock
+  struct proc *owner; // Exclusive holder, for spinning waiters
+
+  // For debugging:
+  char *name;        // Name of lock.
+  int pid;           // Process holding lock exclusively
+};
+
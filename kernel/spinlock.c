@@ -7,13 +7,61 @@
 #include "riscv.h"
 #include "proc.h"
 #include "defs.h"
+#include "lockstat.h"
+
+#define SPINDELAY 32  // idle loops per waiter ahead, between polls
+
+// Counters for lockstat(), one entry per lock name. Each
+// hart counts in its own row of count[], with interrupts off,
+// so taking a lock never writes memory another hart uses;
+// lockstat() adds the rows up. Names are only ever added,
+// under statlock, which is a bare flag since initlock()
+// cannot itself take a spinlock.
+struct lockcount {
+  uint64 nacquire;
+  uint64 nspin;
+  uint64 maxhold;
+};
+
+static struct {
+  char name[16];
+  uint ninit;
+} names[NLOCKSTAT];
+static int nnames;
+static uint statlock;
+static struct lockcount count[NCPU][NLOCKSTAT];
+
+// Return the lockstat index plus one for locks named name,
+// adding an entry if there is none. Returns 0 if the table
+// is full; such locks are not counted.
+static int
+statfor(char *name)
+{
+  int i;
+
+  while(__sync_lock_test_and_set(&statlock, 1) != 0)
+    ;
+  for(i = 0; i < nnames; i++)
+    if(strncmp(names[i].name, name, sizeof(names[i].name) - 1) == 0)
+      break;
+  if(i == nnames && nnames < NLOCKSTAT){
+    safestrcpy(names[i].name, name, sizeof(names[i].name));
+    __atomic_store_n(&nnames, nnames + 1, __ATOMIC_RELEASE);
+  }
+  if(i < nnames)
+    names[i].ninit++;
+  __sync_lock_release(&statlock);
+  return i < NLOCKSTAT ? i + 1 : 0;
+}
 
 void
 initlock(struct spinlock *lk, char *name)
 {
   lk->name = name;
-  lk->locked = 0;
+  lk->next = 0;
+  lk->owner = 0;
   lk->cpu = 0;
+  lk->stat = statfor(name);
 }
 
 // Acquire the lock.
@@ -21,16 +69,27 @@ initlock(struct spinlock *lk, char *name)
 void
 acquire(struct spinlock *lk)
 {
+  uint ticket, cur, i;
+  uint64 spins = 0;
+  struct lockcount *c;
+
   push_off(); // disable interrupts to avoid deadlock.
   if(holding(lk))
     panic("acquire");
 
-  // On RISC-V, sync_lock_test_and_set turns into an atomic swap:
-  //   a5 = 1
-  //   s1 = &lk->locked
-  //   amoswap.w.aq a5, a5, (s1)
-  while(__sync_lock_test_and_set(&lk->locked, 1) != 0)
-    ;
+  // Take a ticket and wait for the holder to pass the lock
+  // to it, so harts get the lock in the order they asked.
+  // On RISC-V, __atomic_fetch_add turns into an atomic add:
+  //   amoadd.w a5, a4, (s1)
+  ticket = __atomic_fetch_add(&lk->next, 1, __ATOMIC_RELAXED);
+  while((cur = __atomic_load_n(&lk->owner, __ATOMIC_ACQUIRE)) != ticket){
+    // Poll less often the further back in line we are, so
+    // waiters do not keep stealing the lock's cache line
+    // from the holder.
+    for(i = (ticket - cur) * SPINDELAY; i > 0; i--)
+      asm volatile("");
+    spins++;
+  }
 
   // Tell the C compiler and the processor to not move loads or stores
   // past this point, to ensure that the critical section's memory
@@ -40,15 +99,32 @@ acquire(struct spinlock *lk)
 
   // Record info about lock acquisition for holding() and debugging.
   lk->cpu = mycpu();
+
+  if(lk->stat){
+    lk->start = r_time();
+    c = &count[cpuid()][lk->stat - 1];
+    c->nacquire++;
+    c->nspin += spins;
+  }
 }
 
 // Release the lock.
 void
 release(struct spinlock *lk)
 {
+  uint64 t;
+  struct lockcount *c;
+
   if(!holding(lk))
     panic("release");
 
+  if(lk->stat){
+    t = r_time() - lk->start;
+    c = &count[cpuid()][lk->stat - 1];
+    if(t > c->maxhold)
+      c->maxhold = t;
+  }
+
   lk->cpu = 0;
 
   // Tell the C compiler and the CPU to not move loads or stores
@@ -59,14 +135,9 @@ release(struct spinlock *lk)
   // On RISC-V, this emits a fence instruction.
   __sync_synchronize();
 
-  // Release the lock, equivalent to lk->locked = 0.
-  // This code doesn't use a C assignment, since the C standard
-  // implies that an assignment might be implemented with
-  // multiple store instructions.
-  // On RISC-V, sync_lock_release turns into an atomic swap:
-  //   s1 = &lk->locked
-  //   amoswap.w zero, zero, (s1)
-  __sync_lock_release(&lk->locked);
+  // Serve the next ticket. Only the holder writes owner, so
+  // a plain increment will do, but it must be one store.
+  __atomic_store_n(&lk->owner, lk->owner + 1, __ATOMIC_RELEASE);
 
   pop_off();
 }
@@ -77,7 +148,7 @@ int
 holding(struct spinlock *lk)
 {
   int r;
-  r = (lk->locked && lk->cpu == mycpu());
+  r = (lk->owner != lk->next && lk->cpu == mycpu());
   return r;
 }
 
@@ -108,3 +179,32 @@ pop_off(void)
   if(c->noff == 0 && c->intena)
     intr_on();
 }
+
+// Copy the counters of up to n lock names to user address
+// addr, for lockstat(). Returns the number copied, or -1.
+// The sums may be a little stale, since other harts go on
+// counting while they are added up.
+int
+lockstat(uint64 addr, int n)
+{
+  struct lockstat st;
+  struct lockcount *c;
+  int i, id, max;
+
+  max = __atomic_load_n(&nnames, __ATOMIC_ACQUIRE);
+  for(i = 0; i < n && i < max; i++){
+    memset(&st, 0, sizeof(st));
+    safestrcpy(st.name, names[i].name, sizeof(st.name));
+    st.ninit = names[i].ninit;
+    for(id = 0; id < NCPU; id++){
+      c = &count[id][i];
+      st.nacquire += c->nacquire;
+      st.nspin += c->nspin;
+      if(c->maxhold > st.maxhold)
+        st.maxhold = c->maxhold;
+    }
+    if(copyout(myproc()->pagetable, addr + i * sizeof(st), (char*)&st, sizeof(st)) < 0)
+      return -1;
+  }
+  return i;
+}
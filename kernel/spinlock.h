@@ -2,12 +2,18 @@
 
 #include "types.h"
 
-// Mutual exclusion lock.
+// Mutual exclusion lock. A ticket lock: harts get it in
+// the order they asked for it.
 struct spinlock {
-  uint locked;       // Is the lock held?
+  uint next;         // Next ticket to hand out.
+  uint owner;        // Ticket that holds the lock.
 
   // For debugging:
   char *name;        // Name of lock.
   struct cpu *cpu;   // The cpu holding the lock.
+
+  // For lockstat():
+  int stat;          // lockstat() entry for this name, plus one; 0 if none.
+  uint64 start;      // When the holder acquired it.
 };
 
@@ -101,6 +101,20 @@ extern uint64 sys_unlink(void);
 extern uint64 sys_link(void);
 extern uint64 sys_mkdir(void);
 extern uint64 sys_close(void);
+extern uint64 sys_rename(void);
+extern uint64 sys_pread(void);
+extern uint64 sys_pwrite(void);
+extern uint64 sys_lseek(void);
+extern uint64 sys_readv(void);
+extern uint64 sys_writev(void);
+extern uint64 sys_splice(void);
+extern uint64 sys_copy_file_range(void);
+extern uint64 sys_uring_setup(void);
+extern uint64 sys_uring_enter(void);
+extern uint64 sys_mmap(void);
+extern uint64 sys_munmap(void);
+extern uint64 sys_nice(void);
+extern uint64 sys_lockstat(void);
 
 // An array mapping syscall numbers from syscall.h
 // to the function that handles the system call.
@@ -126,6 +140,20 @@ static uint64 (*syscalls[])(void) = {
 [SYS_link]    = sys_link,
 [SYS_mkdir]   = sys_mkdir,
 [SYS_close]   = sys_close,
+[SYS_rename]  = sys_rename,
+[SYS_pread]   = sys_pread,
+[SYS_pwrite]  = sys_pwrite,
+[SYS_lseek]   = sys_lseek,
+[SYS_readv]   = sys_readv,
+[SYS_writev]  = sys_writev,
+[SYS_splice]  = sys_splice,
+[SYS_copy_file_range] = sys_copy_file_range,
+[SYS_uring_setup] = sys_uring_setup,
+[SYS_uring_enter] = sys_uring_enter,
+[SYS_mmap]    = sys_mmap,
+[SYS_munmap]  = sys_munmap,
+[SYS_nice]    = sys_nice,
+[SYS_lockstat] = sys_lockstat,
 };
 
 void
@@ -145,3 +173,23 @@ syscall(void)
     p->trapframe->a0 = -1;
   }
 }
+
+// Run system call num with arguments args[0..5], as if the
+// current process had trapped with them in a0..a5, and
+// return its result. uring_enter() uses this to run queued
+// submissions; the caller checks that num is one it allows.
+uint64
+syscallargs(int num, uint64 *args)
+{
+  struct trapframe *tf = myproc()->trapframe;
+  uint64 saved[6], r;
+
+  saved[0] = tf->a0; saved[1] = tf->a1; saved[2] = tf->a2;
+  saved[3] = tf->a3; saved[4] = tf->a4; saved[5] = tf->a5;
+  tf->a0 = args[0]; tf->a1 = args[1]; tf->a2 = args[2];
+  tf->a3 = args[3]; tf->a4 = args[4]; tf->a5 = args[5];
+  r = syscalls[num]();
+  tf->a0 = saved[0]; tf->a1 = saved[1]; tf->a2 = saved[2];
+  tf->a3 = saved[3]; tf->a4 = saved[4]; tf->a5 = saved[5];
+  return r;
+}
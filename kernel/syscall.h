@@ -22,3 +22,17 @@
 #define SYS_link   19
 #define SYS_mkdir  20
 #define SYS_close  21
+#define SYS_rename 22
+#define SYS_pread  23
+#define SYS_pwrite 24
+#define SYS_lseek  25
+#define SYS_readv  26
+#define SYS_writev 27
+#define SYS_splice 28
+#define SYS_copy_file_range 29
+#define SYS_uring_setup 30
+#define SYS_uring_enter 31
+#define SYS_mmap   32
+#define SYS_munmap 33
+#define SYS_nice   34
+#define SYS_lockstat 35
@@ -52,20 +52,9 @@ uint64
 sys_sleep(void)
 {
   int n;
-  uint ticks0;
 
   argint(0, &n);
-  acquire(&tickslock);
-  ticks0 = ticks;
-  while(ticks - ticks0 < n){
-    if(killed(myproc())){
-      release(&tickslock);
-      return -1;
-    }
-    sleep(&ticks, &tickslock);
-  }
-  release(&tickslock);
-  return 0;
+  return timersleep(n);
 }
 
 uint64
@@ -89,3 +78,25 @@ sys_uptime(void)
   release(&tickslock);
   return xticks;
 }
+
+// add to this process's nice value, its base scheduling
+// priority level; returns the new value.
+uint64
+sys_nice(void)
+{
+  int inc;
+
+  argint(0, &inc);
+  return nice(inc);
+}
+
+uint64
+sys_lockstat(void)
+{
+  uint64 addr;
+  int n;
+
+  argaddr(0, &addr);
+  argint(1, &n);
+  return lockstat(addr, n);
+}
@@ -0,0 +1,104 @@
+//
+// One-shot timers, for sleep() system call deadlines.
+//
+// Each hart keeps a timer wheel of NWHEEL slots; a timer due
+// at tick t hangs off slot t % NWHEEL. On every clock
+// interrupt, timertick() moves the hart's wheel up to the
+// current ticks and fires whatever has come due in the slots
+// it passes. So a sleeping process is woken once, at its
+// deadline, instead of at every tick to check the time.
+//
+// A timer stays on the wheel of the hart that armed it, and
+// that hart fires it wherever its sleeper has moved since.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+
+#define NWHEEL 64
+
+struct timer {
+  uint when;           // ticks at which it fires
+  int fired;
+  struct timer *next;  // next in its wheel slot
+};
+
+struct wheel {
+  struct spinlock lock;
+  uint now;            // ticks the wheel has been moved up to
+  struct timer *slot[NWHEEL];
+} wheels[NCPU];
+
+void
+wheelinit(void)
+{
+  for(int i = 0; i < NCPU; i++)
+    initlock(&wheels[i].lock, "wheel");
+}
+
+// Move this hart's wheel up to ticks, firing due timers.
+// Called on every clock interrupt, on every hart.
+void
+timertick(void)
+{
+  struct wheel *w = &wheels[cpuid()];
+  struct timer **tp, *t;
+  uint now = ticks;
+  int n;
+
+  acquire(&w->lock);
+  // visit each slot at most once, however far behind.
+  for(n = 0; w->now != now && n < NWHEEL; n++){
+    w->now++;
+    for(tp = &w->slot[w->now % NWHEEL]; (t = *tp) != 0; ){
+      if((int)(t->when - now) <= 0){
+        *tp = t->next;
+        t->fired = 1;
+        wakeup(t);
+      } else {
+        tp = &t->next;
+      }
+    }
+  }
+  w->now = now;
+  release(&w->lock);
+}
+
+// Sleep for n ticks. Returns 0, or -1 if the process
+// was killed first.
+int
+timersleep(int n)
+{
+  struct proc *p = myproc();
+  struct wheel *w;
+  struct timer t, **tp;
+
+  if(n <= 0)
+    return 0;
+  push_off();
+  w = &wheels[cpuid()];
+  pop_off();
+
+  acquire(&w->lock);
+  t.when = ticks + n;
+  t.fired = 0;
+  t.next = w->slot[t.when % NWHEEL];
+  w->slot[t.when % NWHEEL] = &t;
+  while(!t.fired){
+    if(killed(p)){
+      for(tp = &w->slot[t.when % NWHEEL]; *tp != &t; tp = &(*tp)->next)
+        ;
+      *tp = t.next;
+      release(&w->lock);
+      return -1;
+    }
+    sleep(&t, &w->lock);
+  }
+  release(&w->lock);
+  return 0;
+}
@@ -16,6 +16,8 @@ void kernelvec();
 
 extern int devintr();
 
+extern uint64 timer_scratch[NCPU][7]; // start.c
+
 void
 trapinit(void)
 {
@@ -67,6 +69,17 @@ usertrap(void)
     syscall();
   } else if((which_dev = devintr()) != 0){
     // ok
+  } else if(r_scause() == 12 || r_scause() == 13 || r_scause() == 15){
+    // page fault on a lazily allocated, file-backed or
+    // copy-on-write page. reading a file page can sleep,
+    // so enable interrupts once done with the registers.
+    uint64 scause = r_scause(), stval = r_stval();
+    intr_on();
+    if(vmfault(p->pagetable, stval, scause == 15) < 0){
+      printf("usertrap(): unexpected scause %p pid=%d\n", scause, p->pid);
+      printf("            sepc=%p stval=%p\n", p->trapframe->epc, stval);
+      setkilled(p);
+    }
   } else {
     printf("usertrap(): unexpected scause %p pid=%d\n", r_scause(), p->pid);
     printf("            sepc=%p stval=%p\n", r_sepc(), r_stval());
@@ -76,9 +89,9 @@ usertrap(void)
   if(killed(p))
     exit(-1);
 
-  // give up the CPU if this is a timer interrupt.
+  // maybe give up the CPU if this is a timer interrupt.
   if(which_dev == 2)
-    yield();
+    preempt();
 
   usertrapret();
 }
@@ -120,7 +133,7 @@ usertrapret(void)
   w_sepc(p->trapframe->epc);
 
   // tell trampoline.S the user page table to switch to.
-  uint64 satp = MAKE_SATP(p->pagetable);
+  uint64 satp = MAKE_SATP(p->pagetable) | SATP_ASID(p->asid);
 
   // jump to userret in trampoline.S at the top of memory, which 
   // switches to the user page table, restores user registers,
@@ -150,9 +163,9 @@ kerneltrap()
     panic("kerneltrap");
   }
 
-  // give up the CPU if this is a timer interrupt.
+  // maybe give up the CPU if this is a timer interrupt.
   if(which_dev == 2 && myproc() != 0 && myproc()->state == RUNNING)
-    yield();
+    preempt();
 
   // the yield() may have caused some traps to occur,
   // so restore trap registers for use by kernelvec.S's sepc instruction.
@@ -163,10 +176,24 @@ kerneltrap()
 void
 clockintr()
 {
+  int age;
+
   acquire(&tickslock);
   ticks++;
-  wakeup(&ticks);
+  age = ticks % AGETICKS == 0;
   release(&tickslock);
+
+  if(age)
+    runqage();
+}
+
+// Interrupt hart, to wake it from wfi in scheduler().
+// The CLINT raises a machine software interrupt there,
+// which timervec hands on as a supervisor one.
+void
+ipi(int hart)
+{
+  *(uint32*)CLINT_MSIP(hart) = 1;
 }
 
 // check if it's an external interrupt or software interrupt,
@@ -202,17 +229,23 @@ devintr()
 
     return 1;
   } else if(scause == 0x8000000000000001L){
-    // software interrupt from a machine-mode timer interrupt,
-    // forwarded by timervec in kernelvec.S.
+    // software interrupt from a machine-mode timer interrupt
+    // or an ipi(), forwarded by timervec in kernelvec.S.
 
-    if(cpuid() == 0){
-      clockintr();
-    }
-    
     // acknowledge the software interrupt by clearing
     // the SSIP bit in sip.
     w_sip(r_sip() & ~2);
 
+    // an ipi() only wakes the hart from wfi in scheduler().
+    // swap, since timervec may set the flag again meanwhile.
+    if(__atomic_exchange_n(&timer_scratch[cpuid()][6], 0, __ATOMIC_RELAXED) == 0)
+      return 1;
+
+    if(cpuid() == 0){
+      clockintr();
+    }
+    timertick();
+
     return 2;
   } else {
     return 0;
@@ -0,0 +1,10 @@
+#pragma once
+
+#include "types.h"
+
+// One buffer of a readv() or writev() request.
+// Both the kernel and user programs use this header file.
+struct iovec {
+  void *iov_base;  // Start of buffer
+  uint iov_len;    // Length of buffer in bytes
+};
@@ -0,0 +1,122 @@
+//
+// Submission and completion rings shared with user space,
+// so a process can queue many file system calls and run
+// them all with one uring_enter() trap. The layout is in
+// uring.h. Entries are run synchronously by uring_enter(),
+// in order, through the syscalls[] table.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "syscall.h"
+#include "defs.h"
+#include "uring.h"
+
+// System calls that may be queued. Anything that changes
+// the address space or the process itself (fork, exec, exit,
+// sbrk, ...) must be a real trap.
+static char allowed[] = {
+[SYS_read]    = 1,
+[SYS_write]   = 1,
+[SYS_open]    = 1,
+[SYS_close]   = 1,
+[SYS_fstat]   = 1,
+[SYS_dup]     = 1,
+[SYS_link]    = 1,
+[SYS_unlink]  = 1,
+[SYS_mkdir]   = 1,
+[SYS_rename]  = 1,
+[SYS_pread]   = 1,
+[SYS_pwrite]  = 1,
+[SYS_lseek]   = 1,
+[SYS_readv]   = 1,
+[SYS_writev]  = 1,
+[SYS_splice]  = 1,
+[SYS_copy_file_range] = 1,
+};
+
+// Map a fresh pair of ring pages at URING.
+// Returns URING, or -1 if out of memory.
+uint64
+sys_uring_setup(void)
+{
+  struct proc *p = myproc();
+  char *r, *sq;
+
+  if(p->uring)
+    return URING;
+  if((r = kzalloc()) == 0)
+    return -1;
+  if((sq = kzalloc()) == 0){
+    kfree(r);
+    return -1;
+  }
+  if(mappages(p->pagetable, URING, PGSIZE, (uint64)r, PTE_R | PTE_W | PTE_U) < 0){
+    kfree(r);
+    kfree(sq);
+    return -1;
+  }
+  if(mappages(p->pagetable, URING + PGSIZE, PGSIZE, (uint64)sq, PTE_R | PTE_W | PTE_U) < 0){
+    uvmunmap(p->pagetable, URING, 1, 1);
+    kfree(sq);
+    return -1;
+  }
+  p->uring = (struct uring*)r;
+  return URING;
+}
+
+// Run up to n queued submissions, posting a completion for
+// each. Stops early if the completion ring is full or the
+// process is killed. Returns the number of entries run.
+uint64
+sys_uring_enter(void)
+{
+  struct proc *p = myproc();
+  struct uring *r = p->uring;
+  struct uring_sqe *sq, e;
+  struct uring_cqe *c;
+  int n, done;
+
+  argint(0, &n);
+  if(r == 0)
+    return -1;
+  sq = (struct uring_sqe*)((char*)r + PGSIZE);
+  for(done = 0; done < n; done++){
+    __sync_synchronize();
+    if(r->sq_head == r->sq_tail)
+      break;
+    if(r->sq_tail - r->sq_head > URING_SQSIZE)
+      return -1;  // the process scribbled on sq_tail
+    if(r->cq_tail - r->cq_head >= URING_CQSIZE || killed(p))
+      break;
+    // Copy the entry out first, since the process can
+    // change the ring under us.
+    e = sq[r->sq_head % URING_SQSIZE];
+    r->sq_head++;
+
+    c = &r->cq[r->cq_tail % URING_CQSIZE];
+    c->user_data = e.user_data;
+    if(e.op > 0 && e.op < NELEM(allowed) && allowed[e.op])
+      c->res = syscallargs(e.op, e.args);
+    else
+      c->res = -1;
+    __sync_synchronize();
+    r->cq_tail++;
+  }
+  return done;
+}
+
+// Unmap and free p's rings, if it has any. Called when the
+// address space they belong to goes away, in exec and exit.
+void
+uringfree(struct proc *p)
+{
+  if(p->uring == 0)
+    return;
+  uvmunmap(p->pagetable, URING, 2, 1);
+  p->uring = 0;
+}
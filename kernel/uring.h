@@ -0,0 +1,40 @@
+#pragma once
+
+#include "types.h"
+
+// Submission and completion rings shared between a process
+// and the kernel; see uring.c. Both the kernel and user
+// programs use this header file.
+//
+// uring_setup() maps two pages at URING: the first holds
+// struct uring, the second the array of URING_SQSIZE
+// submission entries. The process fills sq[sq_tail % URING_SQSIZE]
+// and bumps sq_tail; uring_enter() runs queued entries,
+// bumping sq_head, and posts one completion per entry at
+// cq[cq_tail % URING_CQSIZE]. The process consumes completions
+// by bumping cq_head. Head and tail only ever increase.
+
+#define URING_SQSIZE 64   // submission entries (one page)
+#define URING_CQSIZE 128  // completion entries
+
+// A request: run system call op with arguments args[],
+// as if the process had trapped with them in a0..a5.
+struct uring_sqe {
+  int op;           // SYS_read, SYS_write, SYS_open, ...
+  int pad;
+  uint64 args[6];
+  uint64 user_data; // copied to the completion
+};
+
+struct uring_cqe {
+  uint64 user_data; // from the submission
+  uint64 res;       // system call return value, -1 on error
+};
+
+struct uring {
+  uint sq_head;     // written by the kernel
+  uint sq_tail;     // written by the process
+  uint cq_head;     // written by the process
+  uint cq_tail;     // written by the kernel
+  struct uring_cqe cq[URING_CQSIZE];
+};
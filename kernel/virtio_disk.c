@@ -45,7 +45,7 @@ static struct disk {
   // for use when completion interrupt arrives.
   // indexed by first descriptor index of chain.
   struct {
-    struct buf *b;
+    int *busy;
     char status;
   } info[NUM];
 
@@ -211,10 +211,13 @@ alloc3_desc(int *idx)
   return 0;
 }
 
-void
-virtio_disk_rw(struct buf *b, int write)
+// Read or write nblocks consecutive blocks starting at
+// blockno, to or from data. *busy is set while the device
+// owns the request, and is the sleep channel.
+static void
+disk_rw(uint blockno, uchar *data, int nblocks, int *busy, int write)
 {
-  uint64 sector = b->blockno * (BSIZE / 512);
+  uint64 sector = blockno * (BSIZE / 512);
 
   acquire(&disk.vdisk_lock);
 
@@ -248,8 +251,8 @@ virtio_disk_rw(struct buf *b, int write)
   disk.desc[idx[0]].flags = VRING_DESC_F_NEXT;
   disk.desc[idx[0]].next = idx[1];
 
-  disk.desc[idx[1]].addr = (uint64) b->data;
-  disk.desc[idx[1]].len = BSIZE;
+  disk.desc[idx[1]].addr = (uint64) data;
+  disk.desc[idx[1]].len = nblocks * BSIZE;
   if(write)
     disk.desc[idx[1]].flags = 0; // device reads b->data
   else
@@ -263,9 +266,9 @@ virtio_disk_rw(struct buf *b, int write)
   disk.desc[idx[2]].flags = VRING_DESC_F_WRITE; // device writes the status
   disk.desc[idx[2]].next = 0;
 
-  // record struct buf for virtio_disk_intr().
-  b->disk = 1;
-  disk.info[idx[0]].b = b;
+  // record the request for virtio_disk_intr().
+  *busy = 1;
+  disk.info[idx[0]].busy = busy;
 
   // tell the device the first index in our chain of descriptors.
   disk.avail->ring[disk.avail->idx % NUM] = idx[0];
@@ -280,16 +283,33 @@ virtio_disk_rw(struct buf *b, int write)
   *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
 
   // Wait for virtio_disk_intr() to say request has finished.
-  while(b->disk == 1) {
-    sleep(b, &disk.vdisk_lock);
+  while(*busy == 1) {
+    sleep(busy, &disk.vdisk_lock);
   }
 
-  disk.info[idx[0]].b = 0;
+  disk.info[idx[0]].busy = 0;
   free_chain(idx[0]);
 
   release(&disk.vdisk_lock);
 }
 
+void
+virtio_disk_rw(struct buf *b, int write)
+{
+  disk_rw(b->blockno, b->data, 1, &b->disk, write);
+}
+
+// Transfer nblocks consecutive blocks starting at blockno
+// straight to or from data, such as a page cache page,
+// without going through a struct buf.
+void
+virtio_disk_rwblocks(uint blockno, void *data, int nblocks, int write)
+{
+  int busy;
+
+  disk_rw(blockno, data, nblocks, &busy, write);
+}
+
 void
 virtio_disk_intr()
 {
@@ -315,9 +335,9 @@ virtio_disk_intr()
     if(disk.info[id].status != 0)
       panic("virtio_disk_intr status");
 
-    struct buf *b = disk.info[id].b;
-    b->disk = 0;   // disk is done with buf
-    wakeup(b);
+    int *busy = disk.info[id].busy;
+    *busy = 0;   // disk is done with the request
+    wakeup(busy);
 
     disk.used_idx += 1;
   }
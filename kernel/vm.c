@@ -3,6 +3,8 @@
 #include "memlayout.h"
 #include "elf.h"
 #include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
 #include "defs.h"
 
 /*
@@ -14,6 +16,8 @@ extern char etext[];  // kernel.ld sets this to end of kernel code.
 
 extern char trampoline[]; // trampoline.S
 
+uint64 asidmax;  // largest ASID the hardware implements
+
 // Make a direct-map page table for the kernel.
 pagetable_t
 kvmmake(void)
@@ -29,6 +33,9 @@ kvmmake(void)
   // virtio mmio disk interface
   kvmmap(kpgtbl, VIRTIO0, VIRTIO0, PGSIZE, PTE_R | PTE_W);
 
+  // CLINT, for ipi()
+  kvmmap(kpgtbl, CLINT, CLINT, 0x10000, PTE_R | PTE_W);
+
   // PLIC
   kvmmap(kpgtbl, PLIC, PLIC, 0x400000, PTE_R | PTE_W);
 
@@ -63,6 +70,9 @@ kvminithart()
   // wait for any previous writes to the page table memory to finish.
   sfence_vma();
 
+  // the ASID field keeps only the bits the hardware implements.
+  w_satp(MAKE_SATP(kernel_pagetable) | SATP_ASID(0xffff));
+  asidmax = (r_satp() >> 44) & 0xffff;
   w_satp(MAKE_SATP(kernel_pagetable));
 
   // flush stale entries from the TLB.
@@ -81,24 +91,34 @@ kvminithart()
 //   21..29 -- 9 bits of level-1 index.
 //   12..20 -- 9 bits of level-0 index.
 //    0..11 -- 12 bits of byte offset within the page.
-pte_t *
-walk(pagetable_t pagetable, uint64 va, int alloc)
+//
+// walklevel() stops at the PTE of the given level instead;
+// a leaf PTE at level 1 maps a whole 2 MiB superpage.
+static pte_t *
+walklevel(pagetable_t pagetable, uint64 va, int leaf, int alloc)
 {
   if(va >= MAXVA)
     panic("walk");
 
-  for(int level = 2; level > 0; level--) {
+  for(int level = 2; level > leaf; level--) {
     pte_t *pte = &pagetable[PX(level, va)];
     if(*pte & PTE_V) {
+      if(*pte & (PTE_R|PTE_W|PTE_X))
+        panic("walk: superpage");
       pagetable = (pagetable_t)PTE2PA(*pte);
     } else {
-      if(!alloc || (pagetable = (pde_t*)kalloc()) == 0)
+      if(!alloc || (pagetable = (pde_t*)kzalloc()) == 0)
         return 0;
-      memset(pagetable, 0, PGSIZE);
       *pte = PA2PTE(pagetable) | PTE_V;
     }
   }
-  return &pagetable[PX(0, va)];
+  return &pagetable[PX(leaf, va)];
+}
+
+pte_t *
+walk(pagetable_t pagetable, uint64 va, int alloc)
+{
+  return walklevel(pagetable, va, 0, alloc);
 }
 
 // Look up a virtual address, return the physical address,
@@ -127,10 +147,13 @@ walkaddr(pagetable_t pagetable, uint64 va)
 // add a mapping to the kernel page table.
 // only used when booting.
 // does not flush TLB or enable paging.
+// Uses 2 MiB superpages where va and pa line up on one, so
+// the direct map of RAM takes a few page-table pages and
+// few TLB entries.
 void
 kvmmap(pagetable_t kpgtbl, uint64 va, uint64 pa, uint64 sz, int perm)
 {
-  if(mappages(kpgtbl, va, sz, pa, perm) != 0)
+  if(mapsuperpages(kpgtbl, va, sz, pa, perm) != 0)
     panic("kvmmap");
 }
 
@@ -163,8 +186,58 @@ mappages(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int perm)
   return 0;
 }
 
+// Like mappages(), but maps each 2 MiB-aligned stretch of va
+// that pa also lines up with using one level-1 leaf PTE.
+// Only for the kernel page table: the uvm functions expect
+// every leaf to be at level 0.
+int
+mapsuperpages(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int perm)
+{
+  uint64 a, end, n;
+  pte_t *pte;
+
+  if(size == 0)
+    panic("mapsuperpages: size");
+
+  a = PGROUNDDOWN(va);
+  end = PGROUNDUP(va + size);
+  for(; a < end; a += n, pa += n){
+    if(a % SUPERPGSIZE == 0 && pa % SUPERPGSIZE == 0 && end - a >= SUPERPGSIZE){
+      n = SUPERPGSIZE;
+      if((pte = walklevel(pagetable, a, 1, 1)) == 0)
+        return -1;
+      if(*pte & PTE_V)
+        panic("mapsuperpages: remap");
+      *pte = PA2PTE(pa) | perm | PTE_V;
+    } else {
+      n = PGSIZE;
+      if(mappages(pagetable, a, PGSIZE, pa, perm) != 0)
+        return -1;
+    }
+  }
+  return 0;
+}
+
+// Flush this hart's TLB after a change to npages of the
+// mappings at va in pagetable. Only the current process's
+// page table can have entries here: scheduler() flushes a
+// process's ASID when it moves to another hart, and exec()
+// when it switches page tables.
+static void
+uvmflush(pagetable_t pagetable, uint64 va, uint64 npages)
+{
+  struct proc *p = myproc();
+
+  if(p == 0 || p->pagetable != pagetable)
+    return;
+  if(npages == 1)
+    sfence_vma_page(va, p->asid);
+  else
+    sfence_vma_asid(p->asid);
+}
+
 // Remove npages of mappings starting from va. va must be
-// page-aligned. The mappings must exist.
+// page-aligned. Pages that were never faulted in are skipped.
 // Optionally free the physical memory.
 void
 uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
@@ -176,10 +249,8 @@ uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
     panic("uvmunmap: not aligned");
 
   for(a = va; a < va + npages*PGSIZE; a += PGSIZE){
-    if((pte = walk(pagetable, a, 0)) == 0)
-      panic("uvmunmap: walk");
-    if((*pte & PTE_V) == 0)
-      panic("uvmunmap: not mapped");
+    if((pte = walk(pagetable, a, 0)) == 0 || (*pte & PTE_V) == 0)
+      continue;  // lazily allocated, never touched
     if(PTE_FLAGS(*pte) == PTE_V)
       panic("uvmunmap: not a leaf");
     if(do_free){
@@ -188,6 +259,7 @@ uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
     }
     *pte = 0;
   }
+  uvmflush(pagetable, va, npages);
 }
 
 // create an empty user page table.
@@ -196,10 +268,9 @@ pagetable_t
 uvmcreate()
 {
   pagetable_t pagetable;
-  pagetable = (pagetable_t) kalloc();
+  pagetable = (pagetable_t) kzalloc();
   if(pagetable == 0)
     return 0;
-  memset(pagetable, 0, PGSIZE);
   return pagetable;
 }
 
@@ -213,8 +284,7 @@ uvmfirst(pagetable_t pagetable, uchar *src, uint sz)
 
   if(sz >= PGSIZE)
     panic("uvmfirst: more than a page");
-  mem = kalloc();
-  memset(mem, 0, PGSIZE);
+  mem = kzalloc();
   mappages(pagetable, 0, PGSIZE, (uint64)mem, PTE_W|PTE_R|PTE_X|PTE_U);
   memmove(mem, src, sz);
 }
@@ -232,12 +302,11 @@ uvmalloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz, int xperm)
 
   oldsz = PGROUNDUP(oldsz);
   for(a = oldsz; a < newsz; a += PGSIZE){
-    mem = kalloc();
+    mem = kzalloc();
     if(mem == 0){
       uvmdealloc(pagetable, a, oldsz);
       return 0;
     }
-    memset(mem, 0, PGSIZE);
     if(mappages(pagetable, a, PGSIZE, (uint64)mem, PTE_R|PTE_U|xperm) != 0){
       kfree(mem);
       uvmdealloc(pagetable, a, oldsz);
@@ -297,38 +366,151 @@ uvmfree(pagetable_t pagetable, uint64 sz)
 
 // Given a parent process's page table, copy
 // its memory into a child's page table.
-// Copies both the page table and the
-// physical memory.
+// Shares the physical pages rather than copying them:
+// writable pages become read-only and PTE_COW in both
+// tables, and uvmcow() copies one on the first store.
 // returns 0 on success, -1 on failure.
 // frees any allocated pages on failure.
 int
 uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
+{
+  return uvmshare(old, new, 0, sz, 1);
+}
+
+// Map the pages that old maps between page-aligned va and
+// end into new as well. If cow is set, writable pages
+// become copy-on-write in both; otherwise both tables keep
+// writing the same pages.
+// returns 0 on success, -1 on failure.
+// unmaps whatever it mapped on failure.
+int
+uvmshare(pagetable_t old, pagetable_t new, uint64 va, uint64 end, int cow)
 {
   pte_t *pte;
   uint64 pa, i;
   uint flags;
-  char *mem;
 
-  for(i = 0; i < sz; i += PGSIZE){
-    if((pte = walk(old, i, 0)) == 0)
-      panic("uvmcopy: pte should exist");
-    if((*pte & PTE_V) == 0)
-      panic("uvmcopy: page not present");
+  for(i = va; i < end; i += PGSIZE){
+    if((pte = walk(old, i, 0)) == 0 || (*pte & PTE_V) == 0)
+      continue;  // not touched yet
+    if(cow && (*pte & PTE_W))
+      *pte = (*pte & ~PTE_W) | PTE_COW;
     pa = PTE2PA(*pte);
     flags = PTE_FLAGS(*pte);
-    if((mem = kalloc()) == 0)
+    if(mappages(new, i, PGSIZE, pa, flags) != 0)
       goto err;
+    kdup((void*)pa);
+  }
+  // the parent's TLB may still hold writable entries.
+  uvmflush(old, va, (end - va) / PGSIZE);
+  return 0;
+
+ err:
+  uvmunmap(new, va, (i - va) / PGSIZE, 1);
+  uvmflush(old, va, (end - va) / PGSIZE);
+  return -1;
+}
+
+// Give the process a private, writable copy of the
+// copy-on-write page at va, after a store fault or before
+// copyout(). Returns 0 on success, -1 if va is not a
+// copy-on-write page or memory is exhausted.
+int
+uvmcow(pagetable_t pagetable, uint64 va)
+{
+  pte_t *pte;
+  uint64 pa;
+  uint flags;
+  char *mem;
+
+  if(va >= MAXVA)
+    return -1;
+  pte = walk(pagetable, va, 0);
+  if(pte == 0 || (*pte & (PTE_V|PTE_U|PTE_COW)) != (PTE_V|PTE_U|PTE_COW))
+    return -1;
+  pa = PTE2PA(*pte);
+  flags = (PTE_FLAGS(*pte) & ~PTE_COW) | PTE_W;
+  if(krefcnt((void*)pa) == 1){
+    // the other sharers are gone; take the page over.
+    *pte = PA2PTE(pa) | flags;
+  } else {
+    if((mem = kalloc()) == 0)
+      return -1;
     memmove(mem, (char*)pa, PGSIZE);
-    if(mappages(new, i, PGSIZE, (uint64)mem, flags) != 0){
+    *pte = PA2PTE(mem) | flags;
+    kfree((void*)pa);
+  }
+  uvmflush(pagetable, va, 1);
+  return 0;
+}
+
+// Handle a page fault at user address va in the current
+// process: copy a copy-on-write page on a write, read in a
+// page of a file-backed area, or map a zeroed page under
+// p->sz that sbrk() has not allocated yet.
+// Returns 0 if the access can be retried, -1 if it is bad.
+int
+vmfault(pagetable_t pagetable, uint64 va, int write)
+{
+  struct proc *p = myproc();
+  struct vma *v;
+  pte_t *pte;
+  char *mem;
+
+  if(va >= MAXVA)
+    return -1;
+  va = PGROUNDDOWN(va);
+  pte = walk(pagetable, va, 0);
+  if(pte && (*pte & PTE_V)){
+    if(write && (*pte & PTE_COW))
+      return uvmcow(pagetable, va);
+    return -1;
+  }
+  if(p == 0 || pagetable != p->pagetable)
+    return -1;
+  if((v = vmafind(p, va)) != 0){
+    if(vmafill(p, v, va) < 0)
+      return -1;
+  } else {
+    if(va >= p->sz)
+      return -1;
+    if((mem = kzalloc()) == 0)
+      return -1;
+    if(mappages(pagetable, va, PGSIZE, (uint64)mem, PTE_W|PTE_R|PTE_U) != 0){
       kfree(mem);
-      goto err;
+      return -1;
     }
   }
+  // the TLB may hold the old invalid entry.
+  uvmflush(pagetable, va, 1);
   return 0;
+}
 
- err:
-  uvmunmap(new, 0, i / PGSIZE, 1);
-  return -1;
+// Fault in the missing file-backed pages of [va, va+len),
+// for a caller about to copyin() or copyout() while holding
+// a spinlock, when they cannot be read in. Other pages are
+// left to the copy, which can fault them in itself, so a
+// large buffer does not use memory the transfer never
+// touches. Stops at the first bad page and leaves the
+// error to the copy.
+void
+prefault(pagetable_t pagetable, uint64 va, uint64 len)
+{
+  struct proc *p = myproc();
+  struct vma *v;
+  uint64 a, end;
+
+  if(p == 0 || pagetable != p->pagetable || va + len < va)
+    return;
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(v->ip == 0 || v->end <= va || v->start >= va + len)
+      continue;
+    a = PGROUNDDOWN(va > v->start ? va : v->start);
+    end = va + len < v->end ? va + len : v->end;
+    for(; a < end; a += PGSIZE)
+      if(walkaddr(pagetable, a) == 0 && vmfault(pagetable, a, 0) < 0)
+        return;
+  }
 }
 
 // mark a PTE invalid for user access.
@@ -346,17 +528,28 @@ uvmclear(pagetable_t pagetable, uint64 va)
 
 // Copy from kernel to user.
 // Copy len bytes from src to virtual address dstva in a given page table.
+// Faults in lazily allocated pages and copies
+// copy-on-write pages first.
 // Return 0 on success, -1 on error.
 int
 copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
 {
   uint64 n, va0, pa0;
+  pte_t *pte;
 
   while(len > 0){
     va0 = PGROUNDDOWN(dstva);
-    pa0 = walkaddr(pagetable, va0);
-    if(pa0 == 0)
+    if(va0 >= MAXVA)
       return -1;
+    pte = walk(pagetable, va0, 0);
+    if(pte == 0 || (*pte & PTE_V) == 0 || (*pte & PTE_COW)){
+      if(vmfault(pagetable, va0, 1) < 0)
+        return -1;
+      pte = walk(pagetable, va0, 0);
+    }
+    if((*pte & (PTE_V|PTE_U|PTE_W)) != (PTE_V|PTE_U|PTE_W))
+      return -1;
+    pa0 = PTE2PA(*pte);
     n = PGSIZE - (dstva - va0);
     if(n > len)
       n = len;
@@ -371,6 +564,7 @@ copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
 
 // Copy from user to kernel.
 // Copy len bytes to dst from virtual address srcva in a given page table.
+// Faults in lazily allocated pages.
 // Return 0 on success, -1 on error.
 int
 copyin(pagetable_t pagetable, char *dst, uint64 srcva, uint64 len)
@@ -380,8 +574,11 @@ copyin(pagetable_t pagetable, char *dst, uint64 srcva, uint64 len)
   while(len > 0){
     va0 = PGROUNDDOWN(srcva);
     pa0 = walkaddr(pagetable, va0);
-    if(pa0 == 0)
-      return -1;
+    if(pa0 == 0){
+      if(vmfault(pagetable, va0, 0) < 0)
+        return -1;
+      pa0 = walkaddr(pagetable, va0);
+    }
     n = PGSIZE - (srcva - va0);
     if(n > len)
       n = len;
@@ -407,8 +604,11 @@ copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
   while(got_null == 0 && max > 0){
     va0 = PGROUNDDOWN(srcva);
     pa0 = walkaddr(pagetable, va0);
-    if(pa0 == 0)
-      return -1;
+    if(pa0 == 0){
+      if(vmfault(pagetable, va0, 0) < 0)
+        return -1;
+      pa0 = walkaddr(pagetable, va0);
+    }
     n = PGSIZE - (srcva - va0);
     if(n > max)
       n = max;
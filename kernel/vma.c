@@ -0,0 +1,275 @@
+//
+// File-backed areas of user memory: program segments and
+// mmap()ed files. exec() records each program segment as
+// an area instead of reading it in, and vmfault() fills
+// pages from the file on first touch, so a program only
+// reads the pages it uses.
+//
+// Whole pages come from the file's page cache (pagecache.c).
+// A MAP_SHARED area maps the cached pages themselves, so
+// stores go straight to the cache and are written back to
+// the file by munmap() and exit(). A MAP_PRIVATE area maps
+// them read-only, and copy-on-write if writable, so program
+// text is shared by every process running it.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+#include "mman.h"
+#include "fs/vfs_defs.h"
+
+// Take a reference to area v's file, which v->ip names,
+// counting it in ip->ntext if v is program text.
+void
+vmaref(struct vma *v)
+{
+  idup(v->ip);
+  if(v->flags == MAP_PRIVATE && (v->perm & PTE_X))
+    __atomic_fetch_add(&v->ip->ntext, 1, __ATOMIC_RELAXED);
+}
+
+// Drop area v's reference to its file, and free the slot.
+void
+vmaunref(struct vma *v)
+{
+  if(v->flags == MAP_PRIVATE && (v->perm & PTE_X))
+    __atomic_fetch_sub(&v->ip->ntext, 1, __ATOMIC_RELAXED);
+  iput(v->ip);
+  v->ip = 0;
+}
+
+// Return p's area containing va, or 0.
+struct vma*
+vmafind(struct proc *p, uint64 va)
+{
+  struct vma *v;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->ip && va >= v->start && va < v->end)
+      return v;
+  return 0;
+}
+
+// Map the file's cached copy of the page of area v at va.
+static int
+vmashare(struct proc *p, struct vma *v, uint64 va)
+{
+  char *pa;
+  int perm;
+
+  ilockshared(v->ip);
+  if((pa = pcget(v->ip, (v->off + va - v->start) / PGSIZE)) != 0)
+    kdup(pa);
+  iunlock(v->ip);
+  if(pa == 0)
+    return -1;
+  perm = PTE_R|PTE_U|v->perm;
+  if(v->flags == MAP_PRIVATE && (perm & PTE_W))
+    perm = (perm & ~PTE_W) | PTE_COW;
+  if(mappages(p->pagetable, va, PGSIZE, (uint64)pa, perm) != 0){
+    kfree(pa);
+    return -1;
+  }
+  return 0;
+}
+
+// Read the page of area v at va in from the file and map
+// it. The page may need the disk, so the caller must not
+// hold a spinlock; see prefault().
+// Returns 0 on success, -1 on failure.
+int
+vmafill(struct proc *p, struct vma *v, uint64 va)
+{
+  char *mem;
+  uint64 off;
+  int n;
+
+  if(intr_get() == 0)
+    return -1;  // holding a spinlock, cannot sleep
+  va = PGROUNDDOWN(va);
+  off = va - v->start;
+  if((v->off + off) % PGSIZE == 0 && off + PGSIZE <= v->filesz)
+    return vmashare(p, v, va);
+
+  // A partial page at the end of a program segment, or
+  // a segment that is not page-aligned in the file.
+  if((mem = kzalloc()) == 0)
+    return -1;
+  if(off < v->filesz){
+    n = min(PGSIZE, v->filesz - off);
+    ilockshared(v->ip);
+    if(v->ip->op->read(v->ip, 0, (uint64)mem, v->off + off, n) != n){
+      iunlock(v->ip);
+      kfree(mem);
+      return -1;
+    }
+    iunlock(v->ip);
+  }
+  if(mappages(p->pagetable, va, PGSIZE, (uint64)mem, PTE_R|PTE_U|v->perm) != 0){
+    kfree(mem);
+    return -1;
+  }
+  return 0;
+}
+
+// Write the dirty pages of a MAP_SHARED area between va and
+// end back to the file. Pages past the end of the file are
+// not written; mmap() never grows a file.
+static void
+vmawriteback(struct proc *p, struct vma *v, uint64 va, uint64 end)
+{
+  pte_t *pte;
+  uint64 off;
+  int n;
+
+  if(v->flags != MAP_SHARED || (v->perm & PTE_W) == 0)
+    return;
+  ilock(v->ip);
+  for(; va < end; va += PGSIZE){
+    pte = walk(p->pagetable, va, 0);
+    if(pte == 0 || (*pte & PTE_V) == 0 || (*pte & PTE_D) == 0)
+      continue;
+    off = v->off + va - v->start;
+    if(off >= v->ip->size)
+      break;
+    n = min(PGSIZE, v->ip->size - off);
+    v->ip->op->write(v->ip, 0, PTE2PA(*pte), off, n);
+  }
+  iunlock(v->ip);
+}
+
+// Give child np the areas of p, for fork(). Areas above
+// p->sz are outside what uvmcopy() copied, so their pages
+// are shared here: MAP_SHARED pages stay shared and
+// writable, MAP_PRIVATE ones become copy-on-write.
+// Returns 0 on success, -1 if out of memory. Called with
+// np->lock held, so it must not sleep.
+int
+vmadup(struct proc *np, struct proc *p)
+{
+  struct vma *v;
+  int i;
+
+  for(i = 0; i < NVMA; i++){
+    np->vma[i] = p->vma[i];
+    if(p->vma[i].ip)
+      vmaref(&np->vma[i]);
+  }
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(v->ip == 0 || v->start < p->sz)
+      continue;
+    if(uvmshare(p->pagetable, np->pagetable, v->start, PGROUNDUP(v->end),
+                v->flags == MAP_PRIVATE) < 0)
+      goto bad;
+  }
+  return 0;
+
+ bad:
+  // p still holds every inode, so iput() will not sleep.
+  for(v = np->vma; v < &np->vma[NVMA]; v++){
+    if(v->ip == 0)
+      continue;
+    if(v->start >= p->sz)
+      uvmunmap(np->pagetable, v->start, (PGROUNDUP(v->end) - v->start) / PGSIZE, 1);
+    vmaunref(v);
+  }
+  return -1;
+}
+
+// Drop all of p's areas, for exec() and exit(), writing
+// back and unmapping their pages.
+void
+vmaclose(struct proc *p)
+{
+  struct vma *v;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(v->ip){
+      vmawriteback(p, v, v->start, PGROUNDUP(v->end));
+      uvmunmap(p->pagetable, v->start, (PGROUNDUP(v->end) - v->start) / PGSIZE, 1);
+      vmaunref(v);
+    }
+  }
+}
+
+// Return the lowest address above p->sz taken by an area
+// or the rings; the heap may not grow past it.
+uint64
+vmatop(struct proc *p)
+{
+  struct vma *v;
+  uint64 top = URING;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->ip && v->start >= p->sz && v->start < top)
+      top = v->start;
+  return top;
+}
+
+// Map len bytes of ip at file offset off just below the
+// lowest area, for mmap(). perm is PTE_W and/or PTE_X;
+// flags is MAP_SHARED or MAP_PRIVATE. Pages are read in
+// on first touch. Returns the address, or -1.
+uint64
+mmap(struct inode *ip, uint64 len, int perm, int flags, uint off)
+{
+  struct proc *p = myproc();
+  struct vma *v, *free = 0;
+  uint64 va;
+
+  len = PGROUNDUP(len);
+  for(v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->ip == 0 && free == 0)
+      free = v;
+  va = vmatop(p);
+  if(free == 0 || len == 0 || va < len || va - len < PGROUNDUP(p->sz))
+    return -1;
+  va -= len;
+  free->ip = ip;
+  free->start = va;
+  free->end = va + len;
+  free->perm = perm;
+  free->flags = flags;
+  free->off = off;
+  free->filesz = len;
+  vmaref(free);
+  return va;
+}
+
+// Unmap len bytes at va, writing back shared pages. The
+// range must be at the start or the end of one area, or
+// all of it. Returns 0 on success, -1 on failure.
+int
+munmap(uint64 va, uint64 len)
+{
+  struct proc *p = myproc();
+  struct vma *v;
+  uint64 end;
+
+  len = PGROUNDUP(len);
+  if(va % PGSIZE != 0 || len == 0 || (v = vmafind(p, va)) == 0)
+    return -1;
+  end = va + len;
+  if(end < va || end > PGROUNDUP(v->end))
+    return -1;
+  if(va != v->start && end != PGROUNDUP(v->end))
+    return -1;  // would punch a hole
+
+  vmawriteback(p, v, va, end);
+  uvmunmap(p->pagetable, va, len / PGSIZE, 1);
+  if(va == v->start && end >= v->end){
+    vmaunref(v);
+  } else if(va == v->start){
+    v->start = end;
+    v->off += len;
+    v->filesz = v->filesz > len ? v->filesz - len : 0;
+  } else {
+    v->end = va;
+  }
+  return 0;
+}
@@ -0,0 +1,81 @@
+// Measure how page allocation scales across harts: each of
+// n processes repeatedly grows its heap, touches every new
+// page, shrinks it again, and forks a child that exits at
+// once. Runs with 1, 2, 4, ... processes up to nproc and
+// prints the ticks each took; with perfect scaling the
+// times stay flat.
+//
+//   allocbench [nproc [rounds]]
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+#define PAGES 64  // heap pages added per round
+
+// One process's share of the work.
+void
+work(int rounds)
+{
+  char *p;
+  int r, i, pid;
+
+  for(r = 0; r < rounds; r++){
+    if((p = sbrk(PAGES * 4096)) == (char*)-1){
+      fprintf(2, "allocbench: sbrk failed\n");
+      exit(1);
+    }
+    for(i = 0; i < PAGES; i++)
+      p[i * 4096] = i;
+    sbrk(-PAGES * 4096);
+
+    pid = fork();
+    if(pid < 0){
+      fprintf(2, "allocbench: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0)
+      exit(0);
+    wait(0);
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  int nproc, rounds, n, i, t0, t1, xstatus;
+
+  nproc = 4;
+  rounds = 200;
+  if(argc > 1)
+    nproc = atoi(argv[1]);
+  if(argc > 2)
+    rounds = atoi(argv[2]);
+  if(nproc <= 0 || rounds <= 0){
+    fprintf(2, "usage: allocbench [nproc [rounds]]\n");
+    exit(1);
+  }
+
+  for(n = 1; n <= nproc; n *= 2){
+    t0 = uptime();
+    for(i = 0; i < n; i++){
+      int pid = fork();
+      if(pid < 0){
+        fprintf(2, "allocbench: fork failed\n");
+        exit(1);
+      }
+      if(pid == 0){
+        work(rounds);
+        exit(0);
+      }
+    }
+    for(i = 0; i < n; i++){
+      wait(&xstatus);
+      if(xstatus != 0)
+        exit(1);
+    }
+    t1 = uptime();
+    printf("allocbench: %d procs x %d rounds took %d ticks\n", n, rounds, t1 - t0);
+  }
+  exit(0);
+}
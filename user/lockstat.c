@@ -0,0 +1,62 @@
+// Print spinlock contention counters, busiest first.
+// Given a command, run it and print only what it added to
+// acquisitions and spins; the longest hold is since boot.
+//
+//   lockstat [command [arg ...]]
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/lockstat.h"
+#include "user/user.h"
+
+struct lockstat before[NLOCKSTAT], after[NLOCKSTAT];
+
+int
+main(int argc, char *argv[])
+{
+  int n, m, i, j, pid;
+  struct lockstat t;
+
+  if((n = lockstat(before, NLOCKSTAT)) < 0){
+    fprintf(2, "lockstat: lockstat failed\n");
+    exit(1);
+  }
+  if(argc > 1){
+    pid = fork();
+    if(pid < 0){
+      fprintf(2, "lockstat: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      exec(argv[1], argv + 1);
+      fprintf(2, "lockstat: exec %s failed\n", argv[1]);
+      exit(1);
+    }
+    wait(0);
+  } else
+    n = 0;
+  if((m = lockstat(after, NLOCKSTAT)) < 0){
+    fprintf(2, "lockstat: lockstat failed\n");
+    exit(1);
+  }
+
+  // Entries keep their place, so before[i] and after[i]
+  // are the same lock name; new names start from zero.
+  for(i = 0; i < n; i++){
+    after[i].nacquire -= before[i].nacquire;
+    after[i].nspin -= before[i].nspin;
+  }
+  for(i = 1; i < m; i++){
+    t = after[i];
+    for(j = i; j > 0 && after[j-1].nspin < t.nspin; j--)
+      after[j] = after[j-1];
+    after[j] = t;
+  }
+
+  printf("name            inits acquires spins maxhold\n");
+  for(i = 0; i < m; i++)
+    printf("%s%s %d %d %d %d\n", after[i].name,
+           "               " + strlen(after[i].name), after[i].ninit,
+           (int)after[i].nacquire, (int)after[i].nspin, (int)after[i].maxhold);
+  exit(0);
+}
@@ -0,0 +1,66 @@
+// Measure pipe throughput: a child writes through a pipe
+// to its parent, which reads and checks the byte count.
+//
+//   pipebench [kilobytes [chunk]]
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+char buf[8192];
+
+int
+main(int argc, char *argv[])
+{
+  int fds[2], pid, n, chunk, total, got, t0, t1;
+
+  total = 4096;
+  chunk = 512;
+  if(argc > 1)
+    total = atoi(argv[1]);
+  if(argc > 2)
+    chunk = atoi(argv[2]);
+  if(total <= 0 || chunk <= 0 || chunk > sizeof(buf)){
+    fprintf(2, "usage: pipebench [kilobytes [chunk]]\n");
+    exit(1);
+  }
+  total *= 1024;
+
+  if(pipe(fds) < 0){
+    fprintf(2, "pipebench: pipe failed\n");
+    exit(1);
+  }
+
+  t0 = uptime();
+  pid = fork();
+  if(pid < 0){
+    fprintf(2, "pipebench: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    close(fds[0]);
+    for(n = 0; n < total; n += chunk){
+      if(write(fds[1], buf, chunk) != chunk){
+        fprintf(2, "pipebench: write failed\n");
+        exit(1);
+      }
+    }
+    exit(0);
+  }
+
+  close(fds[1]);
+  got = 0;
+  while((n = read(fds[0], buf, sizeof(buf))) > 0)
+    got += n;
+  close(fds[0]);
+  wait(0);
+  t1 = uptime();
+
+  if(got < total){
+    fprintf(2, "pipebench: read %d of %d bytes\n", got, total);
+    exit(1);
+  }
+  printf("pipebench: %d KiB in %d-byte writes took %d ticks\n",
+         got / 1024, chunk, t1 - t0);
+  exit(0);
+}
@@ -3,6 +3,9 @@
 #include "kernel/types.h"
 
 struct stat;
+struct iovec;
+struct uring;
+struct lockstat;
 
 // system calls
 int fork(void);
@@ -26,6 +29,20 @@ int getpid(void);
 char* sbrk(int);
 int sleep(int);
 int uptime(void);
+int rename(const char*, const char*);
+int pread(int, void*, int, int);
+int pwrite(int, const void*, int, int);
+int lseek(int, int, int);
+int readv(int, const struct iovec*, int);
+int writev(int, const struct iovec*, int);
+int splice(int, int, int);
+int copy_file_range(int, int, int);
+struct uring* uring_setup(void);
+int uring_enter(int);
+void* mmap(void*, uint64, int, int, int, int);
+int munmap(void*, uint64);
+int nice(int);
+int lockstat(struct lockstat*, int);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -8,6 +8,10 @@
 #include "kernel/syscall.h"
 #include "kernel/memlayout.h"
 #include "kernel/riscv.h"
+#include "kernel/uio.h"
+#include "kernel/uring.h"
+#include "kernel/mman.h"
+#include "kernel/lockstat.h"
 
 //
 // Tests xv6 system calls.  usertests without arguments runs them all
@@ -22,6 +26,8 @@
 
 char buf[BUFSZ];
 
+int countfree();
+
 //
 // Section with tests that run fairly quickly.  Use -q if you want to
 // run just those.  With -q usertests also runs the ones that take a
@@ -787,6 +793,82 @@ pipe1(char *s)
 }
 
 
+// splice a file into a pipe and the pipe back out to
+// another file, across several ring-fulls.
+void
+splicetest(char *s)
+{
+  enum { SZ = 2*4096 + 100 };
+  int fds[2], fd, fd2, pid, xstatus, n, i;
+
+  for(i = 0; i < SZ; i++)
+    buf[i] = i % 251;
+  unlink("splicein");
+  unlink("spliceout");
+  fd = open("splicein", O_CREATE|O_RDWR);
+  if(fd < 0 || write(fd, buf, SZ) != SZ){
+    printf("%s: write splicein failed\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  if(pipe(fds) != 0){
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    close(fds[0]);
+    fd = open("splicein", O_RDONLY);
+    n = 0;
+    while((i = splice(fd, fds[1], SZ)) > 0)
+      n += i;
+    if(i < 0 || n != SZ){
+      printf("%s: splice file to pipe moved %d\n", s, n);
+      exit(1);
+    }
+    exit(0);
+  }
+  close(fds[1]);
+  fd2 = open("spliceout", O_CREATE|O_RDWR);
+  n = 0;
+  while((i = splice(fds[0], fd2, SZ)) > 0)
+    n += i;
+  close(fds[0]);
+  close(fd2);
+  wait(&xstatus);
+  if(xstatus != 0)
+    exit(xstatus);
+  if(n != SZ){
+    printf("%s: splice pipe to file moved %d\n", s, n);
+    exit(1);
+  }
+
+  fd2 = open("spliceout", O_RDONLY);
+  memset(buf, 0, SZ);
+  if(read(fd2, buf, SZ + 1) != SZ){
+    printf("%s: spliceout has wrong size\n", s);
+    exit(1);
+  }
+  for(i = 0; i < SZ; i++){
+    if((buf[i] & 0xff) != i % 251){
+      printf("%s: spliceout wrong data at %d\n", s, i);
+      exit(1);
+    }
+  }
+  if(splice(fd2, fd2, 1) >= 0){
+    printf("%s: splice file to file succeeded\n", s);
+    exit(1);
+  }
+  close(fd2);
+  unlink("splicein");
+  unlink("spliceout");
+}
+
 // test if child is killed (status = -1)
 void
 killstatus(char *s)
@@ -1146,221 +1228,865 @@ sharedfd(char *s)
   }
 }
 
-// four processes write different files at the same
-// time, to test block allocation.
+// pread/pwrite on a shared descriptor must not use or
+// move the shared offset; lseek moves it explicitly.
 void
-fourfiles(char *s)
+preadtest(char *s)
 {
-  int fd, pid, i, j, n, total, pi;
-  char *names[] = { "f0", "f1", "f2", "f3" };
-  char *fname;
-  enum { N=12, NCHILD=4, SZ=500 };
-  
-  for(pi = 0; pi < NCHILD; pi++){
-    fname = names[pi];
-    unlink(fname);
+  enum { N = 100, SZ = 10 };
+  int fd, pid, i, xstatus;
+  char b[SZ];
 
-    pid = fork();
-    if(pid < 0){
-      printf("fork failed\n", s);
+  unlink("preadf");
+  fd = open("preadf", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: cannot open preadf\n", s);
+    exit(1);
+  }
+  for(i = 0; i < N; i++){
+    memset(b, 'a' + i % 26, SZ);
+    if(write(fd, b, SZ) != SZ){
+      printf("%s: write preadf failed\n", s);
       exit(1);
     }
+  }
+  if(lseek(fd, 0, SEEK_SET) != 0){
+    printf("%s: lseek SEEK_SET failed\n", s);
+    exit(1);
+  }
 
-    if(pid == 0){
-      fd = open(fname, O_CREATE | O_RDWR);
-      if(fd < 0){
-        printf("create failed\n", s);
-        exit(1);
-      }
-
-      memset(buf, '0'+pi, SZ);
-      for(i = 0; i < N; i++){
-        if((n = write(fd, buf, SZ)) != SZ){
-          printf("write failed %d\n", n);
-          exit(1);
-        }
-      }
-      exit(0);
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  // parent reads records forwards, child backwards.
+  for(i = 0; i < N; i++){
+    int rec = pid == 0 ? N - 1 - i : i;
+    if(pread(fd, b, SZ, rec * SZ) != SZ || b[0] != 'a' + rec % 26 ||
+       b[SZ-1] != 'a' + rec % 26){
+      printf("%s: pread record %d wrong\n", s, rec);
+      exit(1);
     }
   }
+  if(pid == 0)
+    exit(0);
+  wait(&xstatus);
+  if(xstatus != 0)
+    exit(xstatus);
 
-  int xstatus;
-  for(pi = 0; pi < NCHILD; pi++){
-    wait(&xstatus);
-    if(xstatus != 0)
-      exit(xstatus);
+  // the shared offset is still where lseek left it.
+  if(read(fd, b, 1) != 1 || b[0] != 'a'){
+    printf("%s: pread moved the file offset\n", s);
+    exit(1);
+  }
+  if(pwrite(fd, "zz", 2, 5*SZ) != 2 || lseek(fd, 0, SEEK_CUR) != 1){
+    printf("%s: pwrite moved the file offset\n", s);
+    exit(1);
+  }
+  if(pread(fd, b, 3, 5*SZ) != 3 || b[0] != 'z' || b[1] != 'z' || b[2] != 'f'){
+    printf("%s: pwrite data wrong\n", s);
+    exit(1);
+  }
+  if(lseek(fd, -SZ, SEEK_END) != (N-1)*SZ){
+    printf("%s: lseek SEEK_END failed\n", s);
+    exit(1);
+  }
+  if(lseek(fd, 1, SEEK_END) >= 0 || lseek(fd, -1, SEEK_SET) >= 0 ||
+     lseek(fd, 0x7fffffff, SEEK_END) >= 0){
+    printf("%s: lseek out of range succeeded\n", s);
+    exit(1);
+  }
+  if(pread(1, b, 1, 0) >= 0){
+    printf("%s: pread on console succeeded\n", s);
+    exit(1);
   }
+  close(fd);
+  unlink("preadf");
+}
 
-  for(i = 0; i < NCHILD; i++){
-    fname = names[i];
-    fd = open(fname, 0);
-    total = 0;
-    while((n = read(fd, buf, sizeof(buf))) > 0){
-      for(j = 0; j < n; j++){
-        if(buf[j] != '0'+i){
-          printf("wrong char\n", s);
+// File data is cached in whole pages: writes and reads in
+// odd-sized chunks that straddle page boundaries must land
+// in the right place, in the cache and on the disk.
+void
+pagecachetest(char *s)
+{
+  enum { N = 3*4096 + 100, W = 1000, R = 777 };
+  int fd, i, n, off;
+
+  unlink("pcachef");
+  fd = open("pcachef", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: cannot open pcachef\n", s);
+    exit(1);
+  }
+  for(off = 0; off < N; off += n){
+    n = N - off < W ? N - off : W;
+    for(i = 0; i < n; i++)
+      buf[i] = (off + i) % 251;
+    if(write(fd, buf, n) != n){
+      printf("%s: write pcachef failed\n", s);
+      exit(1);
+    }
+  }
+  // overwrite a few bytes across the first page boundary.
+  if(pwrite(fd, "xyz", 3, 4095) != 3){
+    printf("%s: pwrite pcachef failed\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  // read back once through the cache, then again from the
+  // disk after the last reference drops the cached pages.
+  for(int pass = 0; pass < 2; pass++){
+    fd = open("pcachef", O_RDONLY);
+    if(fd < 0){
+      printf("%s: cannot reopen pcachef\n", s);
+      exit(1);
+    }
+    for(off = 0; off < N; off += n){
+      if((n = read(fd, buf, R)) <= 0){
+        printf("%s: read pcachef failed at %d\n", s, off);
+        exit(1);
+      }
+      for(i = 0; i < n; i++){
+        int want = (off + i) % 251;
+        if(off + i >= 4095 && off + i < 4098)
+          want = "xyz"[off + i - 4095];
+        if((buf[i] & 0xff) != want){
+          printf("%s: wrong byte at %d\n", s, off + i);
           exit(1);
         }
       }
-      total += n;
     }
-    close(fd);
-    if(total != N*SZ){
-      printf("wrong length %d\n", total);
+    if(read(fd, buf, R) != 0){
+      printf("%s: read past end of pcachef\n", s);
       exit(1);
     }
-    unlink(fname);
+    close(fd);
   }
+  unlink("pcachef");
 }
 
-// four processes create and delete different files in same directory
+// several processes read and stat one file at once, each
+// through its own descriptor and one shared by all, while
+// the inode lock is held shared.
 void
-createdelete(char *s)
+sharedreadtest(char *s)
 {
-  enum { N = 20, NCHILD=4 };
-  int pid, i, fd, pi;
-  char name[32];
+  enum { N = 4, SZ = 3*4096, LOOPS = 5 };
+  int fd, sfd, i, j, pid, xstatus, off;
+  char c;
+  struct stat st;
 
-  for(pi = 0; pi < NCHILD; pi++){
+  unlink("sharedr");
+  fd = open("sharedr", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: cannot create sharedr\n", s);
+    exit(1);
+  }
+  for(i = 0; i < SZ; i++)
+    buf[i] = 'a' + i % 23;
+  if(write(fd, buf, SZ) != SZ){
+    printf("%s: write sharedr failed\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  sfd = open("sharedr", O_RDONLY);
+  for(i = 0; i < N; i++){
     pid = fork();
     if(pid < 0){
-      printf("fork failed\n", s);
+      printf("%s: fork failed\n", s);
       exit(1);
     }
-
     if(pid == 0){
-      name[0] = 'p' + pi;
-      name[2] = '\0';
-      for(i = 0; i < N; i++){
-        name[1] = '0' + i;
-        fd = open(name, O_CREATE | O_RDWR);
-        if(fd < 0){
-          printf("%s: create failed\n", s);
+      fd = open("sharedr", O_RDONLY);
+      if(fd < 0)
+        exit(1);
+      for(j = 0; j < LOOPS; j++){
+        if(pread(fd, buf, SZ, 0) != SZ || fstat(fd, &st) < 0 || st.size != SZ)
           exit(1);
-        }
-        close(fd);
-        if(i > 0 && (i % 2 ) == 0){
-          name[1] = '0' + (i / 2);
-          if(unlink(name) < 0){
-            printf("%s: unlink failed\n", s);
+        for(off = 0; off < SZ; off++)
+          if(buf[off] != 'a' + off % 23)
             exit(1);
-          }
-        }
+        // the shared offset moves by one for each read.
+        if(read(sfd, &c, 1) != 1)
+          exit(1);
       }
       exit(0);
     }
   }
-
-  int xstatus;
-  for(pi = 0; pi < NCHILD; pi++){
+  for(i = 0; i < N; i++){
     wait(&xstatus);
-    if(xstatus != 0)
+    if(xstatus != 0){
+      printf("%s: a reader saw wrong data\n", s);
       exit(1);
-  }
-
-  name[0] = name[1] = name[2] = 0;
-  for(i = 0; i < N; i++){
-    for(pi = 0; pi < NCHILD; pi++){
-      name[0] = 'p' + pi;
-      name[1] = '0' + i;
-      fd = open(name, 0);
-      if((i == 0 || i >= N/2) && fd < 0){
-        printf("%s: oops createdelete %s didn't exist\n", s, name);
-        exit(1);
-      } else if((i >= 1 && i < N/2) && fd >= 0){
-        printf("%s: oops createdelete %s did exist\n", s, name);
-        exit(1);
-      }
-      if(fd >= 0)
-        close(fd);
     }
   }
-
-  for(i = 0; i < N; i++){
-    for(pi = 0; pi < NCHILD; pi++){
-      name[0] = 'p' + i;
-      name[1] = '0' + i;
-      unlink(name);
-    }
+  if(lseek(sfd, 0, SEEK_CUR) != N*LOOPS){
+    printf("%s: shared offset lost a read\n", s);
+    exit(1);
   }
+  close(sfd);
+  unlink("sharedr");
 }
 
-// can I unlink a file and still read it?
+// writev a header and payload as one record, then
+// readv it back split at a different boundary.
 void
-unlinkread(char *s)
+writevtest(char *s)
 {
-  enum { SZ = 5 };
-  int fd, fd1;
+  struct iovec iov[3];
+  char hdr[4], tail[5], b[3000];
+  int fd, i;
 
-  fd = open("unlinkread", O_CREATE | O_RDWR);
+  for(i = 0; i < sizeof(buf); i++)
+    buf[i] = i;
+  memmove(hdr, "HDR:", 4);
+
+  unlink("writevf");
+  fd = open("writevf", O_CREATE|O_RDWR);
   if(fd < 0){
-    printf("%s: create unlinkread failed\n", s);
+    printf("%s: cannot open writevf\n", s);
+    exit(1);
+  }
+  iov[0].iov_base = hdr;
+  iov[0].iov_len = sizeof(hdr);
+  iov[1].iov_base = buf;
+  iov[1].iov_len = 3000;
+  iov[2].iov_base = "!";
+  iov[2].iov_len = 1;
+  if(writev(fd, iov, 3) != 3005){
+    printf("%s: writev failed\n", s);
     exit(1);
   }
-  write(fd, "hello", SZ);
   close(fd);
 
-  fd = open("unlinkread", O_RDWR);
-  if(fd < 0){
-    printf("%s: open unlinkread failed\n", s);
+  fd = open("writevf", O_RDONLY);
+  iov[0].iov_base = b;
+  iov[0].iov_len = sizeof(b);
+  iov[1].iov_base = tail;
+  iov[1].iov_len = sizeof(tail);
+  if(readv(fd, iov, 2) != 3005){
+    printf("%s: readv failed\n", s);
     exit(1);
   }
-  if(unlink("unlinkread") != 0){
-    printf("%s: unlink unlinkread failed\n", s);
+  if(memcmp(b, "HDR:", 4) != 0 || memcmp(b + 4, buf, sizeof(b) - 4) != 0 ||
+     memcmp(tail, buf + 2996, 4) != 0 || tail[4] != '!'){
+    printf("%s: readv data wrong\n", s);
     exit(1);
   }
-
-  fd1 = open("unlinkread", O_CREATE | O_RDWR);
-  write(fd1, "yyy", 3);
-  close(fd1);
-
-  if(read(fd, buf, sizeof(buf)) != SZ){
-    printf("%s: unlinkread read failed", s);
+  if(readv(fd, iov, 2) != 0){
+    printf("%s: readv past end\n", s);
     exit(1);
   }
-  if(buf[0] != 'h'){
-    printf("%s: unlinkread wrong data\n", s);
+  if(writev(fd, iov, 1) >= 0){
+    printf("%s: writev to read-only fd succeeded\n", s);
     exit(1);
   }
-  if(write(fd, buf, 10) != 10){
-    printf("%s: unlinkread write failed\n", s);
+  if(readv(fd, iov, IOV_MAX + 1) >= 0 || readv(fd, (struct iovec*)0xffffffffff, 1) >= 0){
+    printf("%s: readv with bad iovec succeeded\n", s);
     exit(1);
   }
   close(fd);
-  unlink("unlinkread");
+
+  // lengths that each fit in an int but whose sum does not.
+  fd = open("writevf", O_WRONLY);
+  iov[0].iov_base = buf;
+  iov[0].iov_len = 0x40000000;
+  iov[1].iov_base = buf;
+  iov[1].iov_len = 0x40000000;
+  if(fd < 0 || writev(fd, iov, 2) != -1){
+    printf("%s: writev with overflowing total succeeded\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("writevf");
 }
 
+// copy_file_range within xv6fs, at unaligned offsets,
+// and within one file through the kernel bounce buffer.
 void
-linktest(char *s)
+copyfiletest(char *s)
 {
-  enum { SZ = 5 };
-  int fd;
+  enum { SZ = 5000 };
+  int fd, fd2, i;
 
-  unlink("lf1");
-  unlink("lf2");
-
-  fd = open("lf1", O_CREATE|O_RDWR);
-  if(fd < 0){
-    printf("%s: create lf1 failed\n", s);
+  for(i = 0; i < SZ; i++)
+    buf[i] = i % 253;
+  unlink("copyin");
+  unlink("copyout");
+  fd = open("copyin", O_CREATE|O_RDWR);
+  if(fd < 0 || write(fd, buf, SZ) != SZ){
+    printf("%s: write copyin failed\n", s);
     exit(1);
   }
-  if(write(fd, "hello", SZ) != SZ){
-    printf("%s: write lf1 failed\n", s);
+  fd2 = open("copyout", O_CREATE|O_RDWR);
+  if(fd2 < 0 || write(fd2, "abc", 3) != 3){
+    printf("%s: write copyout failed\n", s);
     exit(1);
   }
-  close(fd);
 
-  if(link("lf1", "lf2") < 0){
-    printf("%s: link lf1 lf2 failed\n", s);
+  // start at 7 in the source and 3 in the destination, so
+  // source and destination blocks do not line up.
+  if(lseek(fd, 7, SEEK_SET) != 7){
+    printf("%s: lseek failed\n", s);
     exit(1);
   }
-  unlink("lf1");
-
-  if(open("lf1", 0) >= 0){
-    printf("%s: unlinked lf1 but it is still there!\n", s);
+  if(copy_file_range(fd, fd2, SZ) != SZ - 7){
+    printf("%s: copy_file_range short\n", s);
     exit(1);
   }
-
+  if(copy_file_range(fd, fd2, SZ) != 0){
+    printf("%s: copy_file_range past end\n", s);
+    exit(1);
+  }
+  if(lseek(fd2, 0, SEEK_CUR) != SZ - 4){
+    printf("%s: copy_file_range offset wrong\n", s);
+    exit(1);
+  }
+  close(fd2);
+
+  fd2 = open("copyout", O_RDONLY);
+  memset(buf, 0, SZ);
+  if(read(fd2, buf, SZ) != SZ - 4 || memcmp(buf, "abc", 3) != 0){
+    printf("%s: copyout wrong size\n", s);
+    exit(1);
+  }
+  for(i = 3; i < SZ - 4; i++){
+    if((buf[i] & 0xff) != (i + 4) % 253){
+      printf("%s: copyout wrong data at %d\n", s, i);
+      exit(1);
+    }
+  }
+  close(fd2);
+
+  // append the first 10 bytes of copyin to itself.
+  lseek(fd, 0, SEEK_SET);
+  fd2 = open("copyin", O_RDWR);
+  lseek(fd2, 0, SEEK_END);
+  if(copy_file_range(fd, fd2, 10) != 10 || pread(fd2, buf, 10, SZ) != 10 ||
+     buf[0] != 0 || buf[9] != 9){
+    printf("%s: copy_file_range within one file failed\n", s);
+    exit(1);
+  }
+  if(copy_file_range(fd, 1, 10) >= 0){
+    printf("%s: copy_file_range to console succeeded\n", s);
+    exit(1);
+  }
+  close(fd);
+  close(fd2);
+  unlink("copyin");
+  unlink("copyout");
+}
+
+static void
+uringsub(struct uring *r, int op, uint64 a0, uint64 a1, uint64 a2, uint64 a3, uint64 data)
+{
+  struct uring_sqe *e;
+
+  e = &((struct uring_sqe*)((char*)r + 4096))[r->sq_tail % URING_SQSIZE];
+  e->op = op;
+  e->args[0] = a0;
+  e->args[1] = a1;
+  e->args[2] = a2;
+  e->args[3] = a3;
+  e->user_data = data;
+  r->sq_tail++;
+}
+
+// queue file system calls on the shared rings and run them
+// with uring_enter().
+void
+uringtest(char *s)
+{
+  enum { N = 50 };
+  struct uring *r;
+  struct uring_cqe *c;
+  int fd, i, pid, xstatus;
+
+  if((r = uring_setup()) == (struct uring*)-1){
+    printf("%s: uring_setup failed\n", s);
+    exit(1);
+  }
+  if(uring_setup() != r){
+    printf("%s: second uring_setup moved the rings\n", s);
+    exit(1);
+  }
+  unlink("uringf");
+  uringsub(r, SYS_open, (uint64)"uringf", O_CREATE|O_RDWR, 0, 0, 1);
+  uringsub(r, SYS_fork, 0, 0, 0, 0, 2);
+  if(uring_enter(10) != 2 || r->sq_head != 2 || r->cq_tail != 2){
+    printf("%s: uring_enter ran the wrong number of entries\n", s);
+    exit(1);
+  }
+  c = &r->cq[r->cq_head++ % URING_CQSIZE];
+  fd = c->res;
+  if(c->user_data != 1 || fd < 0){
+    printf("%s: queued open failed\n", s);
+    exit(1);
+  }
+  c = &r->cq[r->cq_head++ % URING_CQSIZE];
+  if(c->user_data != 2 || (int)c->res != -1){
+    printf("%s: queued fork was not refused\n", s);
+    exit(1);
+  }
+
+  // one trap for N positional writes and the close.
+  for(i = 0; i < N; i++){
+    buf[i] = 'a' + i % 26;
+    uringsub(r, SYS_pwrite, fd, (uint64)&buf[i], 1, N - 1 - i, 100 + i);
+  }
+  uringsub(r, SYS_close, fd, 0, 0, 0, 200);
+  if(uring_enter(N + 1) != N + 1){
+    printf("%s: uring_enter short\n", s);
+    exit(1);
+  }
+  for(i = 0; i < N + 1; i++){
+    c = &r->cq[r->cq_head++ % URING_CQSIZE];
+    if(c->user_data != (i < N ? 100 + i : 200) || c->res != (i < N)){
+      printf("%s: bad completion %d\n", s, i);
+      exit(1);
+    }
+  }
+  fd = open("uringf", O_RDONLY);
+  if(fd < 0 || read(fd, buf + N, N) != N){
+    printf("%s: read back failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  for(i = 0; i < N; i++){
+    if(buf[N + i] != buf[N - 1 - i]){
+      printf("%s: wrong data at %d\n", s, i);
+      exit(1);
+    }
+  }
+
+  // the rings stop at a full completion ring.
+  for(i = 0; i < URING_SQSIZE; i++)
+    uringsub(r, SYS_lseek, 99, 0, 0, 0, i);
+  r->cq_head = r->cq_tail - URING_CQSIZE + 10;
+  if(uring_enter(URING_SQSIZE) != 10){
+    printf("%s: overran the completion ring\n", s);
+    exit(1);
+  }
+  r->cq_head = r->cq_tail;
+  if(uring_enter(URING_SQSIZE) != URING_SQSIZE - 10 || r->sq_head != r->sq_tail){
+    printf("%s: uring_enter did not resume\n", s);
+    exit(1);
+  }
+  r->cq_head = r->cq_tail;
+
+  // a child does not share the rings.
+  pid = fork();
+  if(pid == 0){
+    exit(uring_enter(1) == -1 ? 0 : 1);
+  }
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: child inherited the rings\n", s);
+    exit(1);
+  }
+  unlink("uringf");
+}
+
+// mmap() of a file: MAP_PRIVATE stores stay private,
+// MAP_SHARED stores reach the file at munmap() and exit(),
+// and write() is seen through a mapping.
+void
+mmaptest(char *s)
+{
+  enum { SZ = 2*4096 + 2048 };
+  char *p, *q;
+  int fd, i, pid, xstatus;
+
+  unlink("mmapf");
+  fd = open("mmapf", O_CREATE|O_RDWR);
+  for(i = 0; i < SZ; i++)
+    buf[i] = 'a' + i % 23;
+  if(fd < 0 || write(fd, buf, SZ) != SZ){
+    printf("%s: write mmapf failed\n", s);
+    exit(1);
+  }
+
+  p = mmap(0, SZ, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+  if(p == MAP_FAILED || memcmp(p, buf, SZ) != 0){
+    printf("%s: private mapping has wrong data\n", s);
+    exit(1);
+  }
+  for(i = 0; i < SZ + 100; i++)  // zero past the end of the file
+    if(i >= SZ && p[i] != 0){
+      printf("%s: no zeros past end of file\n", s);
+      exit(1);
+    }
+  p[0] = 'X';
+  p[4096] = 'Y';
+  if(munmap(p, SZ) < 0){
+    printf("%s: munmap failed\n", s);
+    exit(1);
+  }
+  if(pread(fd, buf + SZ, 1, 0) != 1 || buf[SZ] != 'a'){
+    printf("%s: private store reached the file\n", s);
+    exit(1);
+  }
+
+  p = mmap(0, SZ, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  if(p == MAP_FAILED){
+    printf("%s: shared mmap failed\n", s);
+    exit(1);
+  }
+  // write() is visible through the mapping.
+  if(pwrite(fd, "hello", 5, 4096 + 10) != 5 || memcmp(p + 4096 + 10, "hello", 5) != 0){
+    printf("%s: mapping did not see write()\n", s);
+    exit(1);
+  }
+  p[1] = 'Z';
+  p[SZ + 10] = 'W';  // past the end of the file: dropped
+  // a child's stores go through the same pages.
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    if(p[1] != 'Z')
+      exit(1);
+    p[2] = 'C';
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0 || p[2] != 'C'){
+    printf("%s: shared mapping not shared with child\n", s);
+    exit(1);
+  }
+  // unmap the first page, then the rest.
+  if(munmap(p, 4096) < 0 || munmap(p + 4096, SZ - 4096) < 0){
+    printf("%s: munmap shared failed\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  fd = open("mmapf", O_RDONLY);
+  memset(buf, 0, SZ + 1);
+  if(read(fd, buf, SZ + 1) != SZ || buf[1] != 'Z' || buf[2] != 'C' ||
+     memcmp(buf + 4096 + 10, "hello", 5) != 0){
+    printf("%s: shared stores not written back\n", s);
+    exit(1);
+  }
+  if(mmap(0, SZ, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0) != MAP_FAILED){
+    printf("%s: writable shared mapping of a read-only fd\n", s);
+    exit(1);
+  }
+  q = mmap(0, 4096, PROT_READ, MAP_SHARED, fd, 4096);
+  if(q == MAP_FAILED || memcmp(q + 10, "hello", 5) != 0){
+    printf("%s: mapping at an offset failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  // the mapping outlives the descriptor.
+  if(q[10] != 'h' || munmap(q, 4096) < 0){
+    printf("%s: mapping lost with close\n", s);
+    exit(1);
+  }
+  unlink("mmapf");
+}
+
+// the text of a running program, such as this one, can be
+// neither written nor truncated.
+void
+textbusy(char *s)
+{
+  int fd;
+
+  fd = open("usertests", O_RDWR);
+  if(fd < 0){
+    printf("%s: open usertests failed\n", s);
+    exit(1);
+  }
+  if(write(fd, "x", 1) != -1 || pwrite(fd, "x", 1, 4096) != -1){
+    printf("%s: wrote to running program\n", s);
+    exit(1);
+  }
+  close(fd);
+  if((fd = open("usertests", O_RDWR|O_TRUNC)) >= 0){
+    printf("%s: truncated running program\n", s);
+    exit(1);
+  }
+}
+
+// fork() of a process with a mapped file, with so little
+// memory free that it fails at every step along the way,
+// including after the heap is copied but before the mapped
+// area is.
+void
+forkoom(char *s)
+{
+  enum { BIG = 256*1024*1024 };  // more than physical memory
+  char *a, *p;
+  int fd, n, i, pid;
+
+  unlink("forkoomf");
+  fd = open("forkoomf", O_CREATE|O_RDWR);
+  if(fd < 0 || write(fd, buf, 4096) != 4096){
+    printf("%s: write forkoomf failed\n", s);
+    exit(1);
+  }
+  p = mmap(0, 4096, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  if(p == MAP_FAILED){
+    printf("%s: mmap failed\n", s);
+    exit(1);
+  }
+  p[0] = 1;
+
+  // use up free memory: reading into an untouched heap page
+  // faults it in, and fails instead of killing us once
+  // memory runs out.
+  a = sbrk(BIG);
+  if(a == (char*)-1){
+    printf("%s: sbrk(BIG) failed\n", s);
+    exit(1);
+  }
+  for(n = 0; n < BIG / 4096; n++)
+    if(pread(fd, a + n * 4096, 1, 0) != 1)
+      break;
+  sbrk(-(BIG - n * 4096));
+
+  // give memory back a page at a time until fork() works.
+  for(i = 0; i < n; i++){
+    sbrk(-4096);
+    pid = fork();
+    if(pid == 0)
+      exit(0);
+    if(pid > 0){
+      wait(0);
+      break;
+    }
+  }
+  if(i == n){
+    printf("%s: fork never succeeded\n", s);
+    exit(1);
+  }
+  munmap(p, 4096);
+  close(fd);
+  unlink("forkoomf");
+}
+
+// four processes write different files at the same
+// time, to test block allocation.
+void
+fourfiles(char *s)
+{
+  int fd, pid, i, j, n, total, pi;
+  char *names[] = { "f0", "f1", "f2", "f3" };
+  char *fname;
+  enum { N=12, NCHILD=4, SZ=500 };
+  
+  for(pi = 0; pi < NCHILD; pi++){
+    fname = names[pi];
+    unlink(fname);
+
+    pid = fork();
+    if(pid < 0){
+      printf("fork failed\n", s);
+      exit(1);
+    }
+
+    if(pid == 0){
+      fd = open(fname, O_CREATE | O_RDWR);
+      if(fd < 0){
+        printf("create failed\n", s);
+        exit(1);
+      }
+
+      memset(buf, '0'+pi, SZ);
+      for(i = 0; i < N; i++){
+        if((n = write(fd, buf, SZ)) != SZ){
+          printf("write failed %d\n", n);
+          exit(1);
+        }
+      }
+      exit(0);
+    }
+  }
+
+  int xstatus;
+  for(pi = 0; pi < NCHILD; pi++){
+    wait(&xstatus);
+    if(xstatus != 0)
+      exit(xstatus);
+  }
+
+  for(i = 0; i < NCHILD; i++){
+    fname = names[i];
+    fd = open(fname, 0);
+    total = 0;
+    while((n = read(fd, buf, sizeof(buf))) > 0){
+      for(j = 0; j < n; j++){
+        if(buf[j] != '0'+i){
+          printf("wrong char\n", s);
+          exit(1);
+        }
+      }
+      total += n;
+    }
+    close(fd);
+    if(total != N*SZ){
+      printf("wrong length %d\n", total);
+      exit(1);
+    }
+    unlink(fname);
+  }
+}
+
+// four processes create and delete different files in same directory
+void
+createdelete(char *s)
+{
+  enum { N = 20, NCHILD=4 };
+  int pid, i, fd, pi;
+  char name[32];
+
+  for(pi = 0; pi < NCHILD; pi++){
+    pid = fork();
+    if(pid < 0){
+      printf("fork failed\n", s);
+      exit(1);
+    }
+
+    if(pid == 0){
+      name[0] = 'p' + pi;
+      name[2] = '\0';
+      for(i = 0; i < N; i++){
+        name[1] = '0' + i;
+        fd = open(name, O_CREATE | O_RDWR);
+        if(fd < 0){
+          printf("%s: create failed\n", s);
+          exit(1);
+        }
+        close(fd);
+        if(i > 0 && (i % 2 ) == 0){
+          name[1] = '0' + (i / 2);
+          if(unlink(name) < 0){
+            printf("%s: unlink failed\n", s);
+            exit(1);
+          }
+        }
+      }
+      exit(0);
+    }
+  }
+
+  int xstatus;
+  for(pi = 0; pi < NCHILD; pi++){
+    wait(&xstatus);
+    if(xstatus != 0)
+      exit(1);
+  }
+
+  name[0] = name[1] = name[2] = 0;
+  for(i = 0; i < N; i++){
+    for(pi = 0; pi < NCHILD; pi++){
+      name[0] = 'p' + pi;
+      name[1] = '0' + i;
+      fd = open(name, 0);
+      if((i == 0 || i >= N/2) && fd < 0){
+        printf("%s: oops createdelete %s didn't exist\n", s, name);
+        exit(1);
+      } else if((i >= 1 && i < N/2) && fd >= 0){
+        printf("%s: oops createdelete %s did exist\n", s, name);
+        exit(1);
+      }
+      if(fd >= 0)
+        close(fd);
+    }
+  }
+
+  for(i = 0; i < N; i++){
+    for(pi = 0; pi < NCHILD; pi++){
+      name[0] = 'p' + i;
+      name[1] = '0' + i;
+      unlink(name);
+    }
+  }
+}
+
+// can I unlink a file and still read it?
+void
+unlinkread(char *s)
+{
+  enum { SZ = 5 };
+  int fd, fd1;
+
+  fd = open("unlinkread", O_CREATE | O_RDWR);
+  if(fd < 0){
+    printf("%s: create unlinkread failed\n", s);
+    exit(1);
+  }
+  write(fd, "hello", SZ);
+  close(fd);
+
+  fd = open("unlinkread", O_RDWR);
+  if(fd < 0){
+    printf("%s: open unlinkread failed\n", s);
+    exit(1);
+  }
+  if(unlink("unlinkread") != 0){
+    printf("%s: unlink unlinkread failed\n", s);
+    exit(1);
+  }
+
+  fd1 = open("unlinkread", O_CREATE | O_RDWR);
+  write(fd1, "yyy", 3);
+  close(fd1);
+
+  if(read(fd, buf, sizeof(buf)) != SZ){
+    printf("%s: unlinkread read failed", s);
+    exit(1);
+  }
+  if(buf[0] != 'h'){
+    printf("%s: unlinkread wrong data\n", s);
+    exit(1);
+  }
+  if(write(fd, buf, 10) != 10){
+    printf("%s: unlinkread write failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("unlinkread");
+}
+
+void
+linktest(char *s)
+{
+  enum { SZ = 5 };
+  int fd;
+
+  unlink("lf1");
+  unlink("lf2");
+
+  fd = open("lf1", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: create lf1 failed\n", s);
+    exit(1);
+  }
+  if(write(fd, "hello", SZ) != SZ){
+    printf("%s: write lf1 failed\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  if(link("lf1", "lf2") < 0){
+    printf("%s: link lf1 lf2 failed\n", s);
+    exit(1);
+  }
+  unlink("lf1");
+
+  if(open("lf1", 0) >= 0){
+    printf("%s: unlinked lf1 but it is still there!\n", s);
+    exit(1);
+  }
+
   fd = open("lf2", 0);
   if(fd < 0){
     printf("%s: open lf2 failed\n", s);
@@ -1389,6 +2115,145 @@ linktest(char *s)
   }
 }
 
+// rename within a directory, over an existing file,
+// and of a directory into another directory.
+void
+renametest(char *s)
+{
+  enum { SZ = 5 };
+  int fd;
+
+  unlink("rn1");
+  unlink("rn2");
+
+  fd = open("rn1", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: create rn1 failed\n", s);
+    exit(1);
+  }
+  if(write(fd, "hello", SZ) != SZ){
+    printf("%s: write rn1 failed\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  if(rename("rn1", "rn2") != 0){
+    printf("%s: rename rn1 rn2 failed\n", s);
+    exit(1);
+  }
+  if(open("rn1", 0) >= 0){
+    printf("%s: renamed rn1 but it is still there!\n", s);
+    exit(1);
+  }
+  fd = open("rn2", 0);
+  if(fd < 0 || read(fd, buf, sizeof(buf)) != SZ || buf[0] != 'h'){
+    printf("%s: read rn2 failed\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  // replace an existing file.
+  fd = open("rn1", O_CREATE|O_RDWR);
+  write(fd, "xyz", 3);
+  close(fd);
+  if(rename("rn1", "rn2") != 0){
+    printf("%s: rename over rn2 failed\n", s);
+    exit(1);
+  }
+  fd = open("rn2", 0);
+  if(fd < 0 || read(fd, buf, sizeof(buf)) != 3 || buf[0] != 'x'){
+    printf("%s: rn2 not replaced\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  if(rename("rn1", "rn3") >= 0){
+    printf("%s: rename non-existent succeeded! oops\n", s);
+    exit(1);
+  }
+
+  // move a directory and check that its ".." follows.
+  if(mkdir("rnd1") != 0 || mkdir("rnd2") != 0){
+    printf("%s: mkdir rnd failed\n", s);
+    exit(1);
+  }
+  if(rename("rn2", "rnd1/rn2") != 0){
+    printf("%s: rename rn2 into rnd1 failed\n", s);
+    exit(1);
+  }
+  if(rename("rnd1", "rnd1/sub") >= 0){
+    printf("%s: rename rnd1 into itself succeeded! oops\n", s);
+    exit(1);
+  }
+  if(rename("rnd1", "rnd2/rnd1") != 0){
+    printf("%s: rename rnd1 into rnd2 failed\n", s);
+    exit(1);
+  }
+  if(chdir("rnd2/rnd1") != 0){
+    printf("%s: chdir rnd2/rnd1 failed\n", s);
+    exit(1);
+  }
+  if((fd = open("../../rnd2/rnd1/rn2", 0)) < 0){
+    printf("%s: .. of moved directory is wrong\n", s);
+    exit(1);
+  }
+  close(fd);
+  if(chdir("../..") != 0){
+    printf("%s: chdir ../.. failed\n", s);
+    exit(1);
+  }
+
+  if(unlink("rnd2/rnd1/rn2") != 0 || unlink("rnd2/rnd1") != 0 ||
+     unlink("rnd2") != 0){
+    printf("%s: unlink renamed tree failed\n", s);
+    exit(1);
+  }
+}
+
+// rename onto an ancestor of the source fails, and does not
+// deadlock with an unlink() of the directory in between.
+void
+renameancestor(char *s)
+{
+  enum { N = 200 };
+  int pid, i, fd, xstatus;
+
+  if(mkdir("ra") != 0 || mkdir("ra/b") != 0 || mkdir("ra/b/c") != 0 ||
+     (fd = open("ra/b/c/f", O_CREATE|O_RDWR)) < 0){
+    printf("%s: create ra/b/c/f failed\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    for(i = 0; i < N; i++)
+      if(rename("ra/b/c/f", "ra/b") == 0)
+        exit(1);
+    exit(0);
+  }
+  for(i = 0; i < N; i++){
+    if(unlink("ra/b/c") == 0){
+      printf("%s: unlinked non-empty directory\n", s);
+      exit(1);
+    }
+  }
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: rename onto an ancestor succeeded\n", s);
+    exit(1);
+  }
+  if(unlink("ra/b/c/f") != 0 || unlink("ra/b/c") != 0 ||
+     unlink("ra/b") != 0 || unlink("ra") != 0){
+    printf("%s: unlink ra failed\n", s);
+    exit(1);
+  }
+}
+
 // test concurrent create/link/unlink of the same file
 void
 concreate(char *s)
@@ -1994,6 +2859,197 @@ forktest(char *s)
   }
 }
 
+// nice() moves the base priority level within 0..NPRIO-1,
+// and fork() passes it on.
+void
+nicetest(char *s)
+{
+  int pid, xstatus;
+
+  if(nice(0) != 0 || nice(1) != 1 || nice(100) != NPRIO-1){
+    printf("%s: nice returned the wrong level\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0)
+    exit(nice(0) != NPRIO-1);
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: child did not inherit nice\n", s);
+    exit(1);
+  }
+  if(nice(-100) != 0){
+    printf("%s: nice did not go back to 0\n", s);
+    exit(1);
+  }
+}
+
+// lockstat() counts acquisitions per lock name, and fails
+// on a bad buffer.
+void
+lockstattest(char *s)
+{
+  static struct lockstat st[NLOCKSTAT];
+  int fds[2], n, i, found = 0;
+  uint64 before = 0;
+  char c = 'x';
+
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  n = lockstat(st, NLOCKSTAT);
+  for(i = 0; i < n; i++)
+    if(strcmp(st[i].name, "pipe") == 0){
+      before = st[i].nacquire;
+      found = 1;
+    }
+  if(!found){
+    printf("%s: no pipe lock counted\n", s);
+    exit(1);
+  }
+  if(write(fds[1], &c, 1) != 1 || read(fds[0], &c, 1) != 1){
+    printf("%s: pipe i/o failed\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+  n = lockstat(st, NLOCKSTAT);
+  for(i = 0; i < n; i++)
+    if(strcmp(st[i].name, "pipe") == 0 && st[i].nacquire < before + 2){
+      printf("%s: pipe acquisitions not counted\n", s);
+      exit(1);
+    }
+  if(lockstat((struct lockstat*)0xffffffffffffff00ULL, NLOCKSTAT) != -1){
+    printf("%s: lockstat took a bad buffer\n", s);
+    exit(1);
+  }
+}
+
+// fork shares pages copy-on-write: parent and child each
+// see only their own stores, including stores the kernel
+// makes with copyout(). a process holding more than half
+// of free memory can still fork.
+void
+cowtest(char *s)
+{
+  enum { N = 64*4096 };
+  char *a, *big;
+  int i, pid, xstatus, fds[2];
+  uint64 bigsz;
+
+  a = sbrk(N);
+  if(a == (char*)-1){
+    printf("%s: sbrk failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < N; i += 4096)
+    a[i] = i / 4096;
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    for(i = 0; i < N; i += 4096)
+      a[i] = 'c';
+    if(read(fds[0], a + 4096*3 + 10, 5) != 5 || memcmp(a + 4096*3 + 10, "hello", 5) != 0)
+      exit(1);
+    exit(0);
+  }
+  if(write(fds[1], "hello", 5) != 5){
+    printf("%s: pipe write failed\n", s);
+    exit(1);
+  }
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: child saw wrong data\n", s);
+    exit(1);
+  }
+  for(i = 0; i < N; i += 4096){
+    if(a[i] != i / 4096 || (i == 4096*3 && a[i + 10] != 0)){
+      printf("%s: parent saw the child's store at %d\n", s, i);
+      exit(1);
+    }
+  }
+  close(fds[0]);
+  close(fds[1]);
+  sbrk(-N);
+
+  // take most of free memory, then fork twice.
+  bigsz = countfree() / 3 * 2 * 4096;
+  big = sbrk(bigsz);
+  if(big == (char*)-1){
+    printf("%s: sbrk big failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < bigsz; i += 4096)
+    big[i] = 1;
+  for(i = 0; i < 2; i++){
+    pid = fork();
+    if(pid < 0){
+      printf("%s: fork of a big process failed\n", s);
+      exit(1);
+    }
+    if(pid == 0)
+      exit(big[bigsz - 4096] == 1 ? 0 : 1);
+    wait(&xstatus);
+    if(xstatus != 0){
+      printf("%s: big child saw wrong data\n", s);
+      exit(1);
+    }
+  }
+  sbrk(-bigsz);
+}
+
+// program data is read in from the executable on first
+// touch, including when the kernel touches it first, with
+// a lock held, as pipe i/o and wait() do.
+char datapages[4*4096] = { 1 };
+int datastatus = 1;
+
+void
+demandpage(char *s)
+{
+  int fds[2], pid;
+
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  if(write(fds[1], datapages + 4096*2, 10) != 10 ||
+     read(fds[0], datapages + 4096*3 + 100, 10) != 10){
+    printf("%s: pipe i/o on data pages failed\n", s);
+    exit(1);
+  }
+  if(datapages[0] != 1 || datapages[4096*3 + 100] != 0){
+    printf("%s: wrong data\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0)
+    exit(0);
+  if(wait(&datastatus) != pid || datastatus != 0){
+    printf("%s: wait did not store the status\n", s);
+    exit(1);
+  }
+}
+
 void
 sbrkbasic(char *s)
 {
@@ -2058,6 +3114,96 @@ sbrkbasic(char *s)
   exit(xstatus);
 }
 
+// sbrk() only reserves memory; pages are allocated, zeroed,
+// when first touched by the program or by a system call.
+void
+lazysbrk(char *s)
+{
+  enum { BIG = 256*1024*1024 };  // more than physical memory
+  char *a, *c;
+  int fds[2], pid, xstatus;
+
+  a = sbrk(BIG);
+  if(a == (char*)-1){
+    printf("%s: sbrk(BIG) failed\n", s);
+    exit(1);
+  }
+  a[0] = 1;
+  a[BIG - 1] = 2;
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  // copyin() from an untouched page, copyout() to another.
+  if(write(fds[1], a + BIG/2, 10) != 10 || read(fds[0], a + BIG/4 + 5, 10) != 10){
+    printf("%s: pipe i/o on lazy pages failed\n", s);
+    exit(1);
+  }
+  for(c = a + BIG/4 + 5; c < a + BIG/4 + 15; c++){
+    if(*c != 0){
+      printf("%s: lazy page not zeroed\n", s);
+      exit(1);
+    }
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0)
+    exit(a[0] == 1 && a[BIG - 1] == 2 && a[BIG/8] == 0 ? 0 : 1);
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: child saw wrong data\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+  if(sbrk(-BIG) == (char*)-1){
+    printf("%s: sbrk(-BIG) failed\n", s);
+    exit(1);
+  }
+}
+
+// a read() into a huge lazy buffer allocates only the pages
+// the data lands on, not the whole buffer.
+void
+lazyread(char *s)
+{
+  enum { BIG = 256*1024*1024 };  // more than physical memory
+  char *a;
+  int fd, n, pid, xstatus;
+
+  if((fd = open("README", 0)) < 0){
+    printf("%s: open README failed\n", s);
+    exit(1);
+  }
+  a = sbrk(BIG);
+  if(a == (char*)-1){
+    printf("%s: sbrk(BIG) failed\n", s);
+    exit(1);
+  }
+  n = read(fd, a, BIG);
+  close(fd);
+  if(n <= 0 || n >= 64*1024){
+    printf("%s: read returned %d\n", s, n);
+    exit(1);
+  }
+  // with all memory taken, fork() could not copy the heap.
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed; read used up memory\n", s);
+    exit(1);
+  }
+  if(pid == 0)
+    exit(a[0] == 0 || a[BIG/2] != 0);
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: child saw wrong data\n", s);
+    exit(1);
+  }
+}
+
 void
 sbrkmuch(char *s)
 {
@@ -2595,6 +3741,7 @@ struct test {
   {dirtest, "dirtest"},
   {exectest, "exectest"},
   {pipe1, "pipe1"},
+  {splicetest, "splicetest"},
   {killstatus, "killstatus"},
   {preempt, "preempt"},
   {exitwait, "exitwait"},
@@ -2605,10 +3752,21 @@ struct test {
   {reparent2, "reparent2"},
   {mem, "mem"},
   {sharedfd, "sharedfd"},
+  {preadtest, "preadtest"},
+  {pagecachetest, "pagecachetest"},
+  {sharedreadtest, "sharedreadtest"},
+  {writevtest, "writevtest"},
+  {copyfiletest, "copyfiletest"},
+  {uringtest, "uringtest"},
+  {mmaptest, "mmaptest"},
+  {forkoom, "forkoom"},
+  {textbusy, "textbusy"},
   {fourfiles, "fourfiles"},
   {createdelete, "createdelete"},
   {unlinkread, "unlinkread"},
   {linktest, "linktest"},
+  {renametest, "renametest"},
+  {renameancestor, "renameancestor"},
   {concreate, "concreate"},
   {linkunlink, "linkunlink"},
   {subdir, "subdir"},
@@ -2619,8 +3777,14 @@ struct test {
   {dirfile, "dirfile"},
   {iref, "iref"},
   {forktest, "forktest"},
+  {cowtest, "cowtest"},
+  {nicetest, "nicetest"},
+  {lockstattest, "lockstattest"},
+  {demandpage, "demandpage"},
   {sbrkbasic, "sbrkbasic"},
   {sbrkmuch, "sbrkmuch"},
+  {lazysbrk, "lazysbrk"},
+  {lazyread, "lazyread"},
   {kernmem, "kernmem"},
   {MAXVAplus, "MAXVAplus"},
   {sbrkfail, "sbrkfail"},
@@ -2654,10 +3818,17 @@ struct test fstests1[] = {
   {dirtest, "dirtest"},
   {exectest, "exectest"},
   {sharedfd, "sharedfd"},
+  {preadtest, "preadtest"},
+  {pagecachetest, "pagecachetest"},
+  {sharedreadtest, "sharedreadtest"},
+  {writevtest, "writevtest"},
+  {copyfiletest, "copyfiletest"},
   {fourfiles, "fourfiles"},
   {createdelete, "createdelete"},
   {unlinkread, "unlinkread"},
   {linktest, "linktest"},
+  {renametest, "renametest"},
+  {renameancestor, "renameancestor"},
   {concreate, "concreate"},
   {linkunlink, "linkunlink"},
   {subdir, "subdir"},
@@ -36,3 +36,17 @@ entry("getpid");
 entry("sbrk");
 entry("sleep");
 entry("uptime");
+entry("rename");
+entry("pread");
+entry("pwrite");
+entry("lseek");
+entry("readv");
+entry("writev");
+entry("splice");
+entry("copy_file_range");
+entry("uring_setup");
+entry("uring_enter");
+entry("mmap");
+entry("munmap");
+entry("nice");
+entry("lockstat");